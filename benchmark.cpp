@@ -0,0 +1,575 @@
+// Benchmarks for the Matrix class in Linear Algebra library
+//
+// Usage: benchmark_program [--format table|json|csv] [--output FILE] [--max-size N] [--sizes N,N,...]
+//                          [--types double,float,int] [--filter SUBSTRING] [--min-time SECONDS] [--threads N]
+//                          [--peak-gflops X] [--peak-bandwidth GBPS]
+//
+// Every case reports the median time per operation, GFLOP/s, bytes/s and the percentage of the machine's peak:
+// compute-bound cases (products) are compared with the theoretical floating point peak, memory-bound cases
+// (transpose, copy, elementwise) with the measured bandwidth of a large memcpy, so cases that fit in cache can
+// exceed 100%. Integer cases use the 32-bit lane peak. Pass --peak-gflops / --peak-bandwidth to compare against
+// known figures instead. JSON and CSV output are meant to be diffed between runs.
+
+#include "linear_algebra.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+namespace {
+
+struct Options {
+    std::string format = "table";
+    std::string output;
+    std::vector<int> sizes;
+    int max_size = 1024;
+    std::vector<std::string> types = {"double", "float", "int"};
+    std::string filter;
+    double min_time = 0.2;
+    int threads = 1;
+    double peak_gflops = 0.0;
+    double peak_bandwidth = 0.0;
+};
+
+struct Result {
+    std::string name;
+    std::string type;
+    int m, n, k;
+    int repetitions;
+    double median_seconds;
+    double min_seconds;
+    double flops;  // Floating point (or integer) operations per run, 0 for pure data movement.
+    double bytes;  // Bytes read and written per run, counting every operand once.
+};
+
+template<typename Scalar> const char* typeName();
+template<> const char* typeName<double>() { return "double"; }
+template<> const char* typeName<float>() { return "float"; }
+template<> const char* typeName<int>() { return "int"; }
+
+// Operand types of the mixed-precision multiply case whose product is accumulated in Scalar.
+template<typename Scalar> struct MixedInputs;
+template<> struct MixedInputs<double> { typedef float left; typedef double right; };
+template<> struct MixedInputs<float> { typedef LinearAlgebra::BFloat16 left; typedef LinearAlgebra::BFloat16 right; };
+template<> struct MixedInputs<int> { typedef std::int8_t left; typedef std::int8_t right; };
+
+const char* simdLevelName(LinearAlgebra::SimdLevel level) {
+    switch (level) {
+        case LinearAlgebra::SimdLevel::AVX512: return "avx512";
+        case LinearAlgebra::SimdLevel::AVX2: return "avx2";
+        case LinearAlgebra::SimdLevel::SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+// Keeps the optimizer from discarding results that are never read.
+volatile double benchmark_sink;
+
+template<typename Scalar>
+void fillMatrix(LinearAlgebra::Matrix<Scalar>& matrix) {
+    LinearAlgebra::MatrixView<Scalar> view = matrix.view();
+    for (int i = 0; i < matrix.getRows(); ++i) {
+        for (int j = 0; j < matrix.getCols(); ++j) {
+            view.set(i, j, static_cast<Scalar>((i * 7 + j * 3) % 11 - 5));
+        }
+    }
+}
+
+/**
+ * Runs "operation" once to warm up caches and pools, then repeatedly until at least min_time seconds have been
+ * measured (and at least 3 times unless a single run already takes longer than that).
+ * @returns: The result with its timing fields filled in.
+*/
+template<typename Operation>
+Result measure(Result result, double min_time, Operation operation) {
+    typedef std::chrono::steady_clock Clock;
+    operation();
+    std::vector<double> times;
+    double total = 0.0;
+    while (total < min_time || (times.size() < 3 && total < 3 * min_time)) {
+        Clock::time_point start = Clock::now();
+        operation();
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        times.push_back(elapsed);
+        total += elapsed;
+    }
+    std::sort(times.begin(), times.end());
+    result.repetitions = static_cast<int>(times.size());
+    result.median_seconds = times[times.size() / 2];
+    result.min_seconds = times.front();
+    return result;
+}
+
+class Runner {
+    public:
+        Runner(const Options& input_options) : options(input_options) {}
+
+        const std::vector<Result>& getResults() const { return results; }
+
+        template<typename Scalar>
+        void runType() {
+            std::vector<int> sizes = options.sizes;
+            if (sizes.empty()) {
+                for (int n = 4; n <= 8192; n *= 2) {
+                    sizes.push_back(n);
+                }
+            }
+            for (int n : sizes) {
+                if (n > options.max_size) {
+                    continue;
+                }
+                multiply<Scalar>("multiply", n, n, n);
+                multiply<Scalar>("multiply_transposed_a", n, n, n, true);
+                multiplyMixed<Scalar>(n);
+                if (n >= 64) {
+                    // Skinny shapes: matrix times panel, panel times matrix and a rank-32 update.
+                    multiply<Scalar>("multiply", n, 32, n);
+                    multiply<Scalar>("multiply", 32, n, n);
+                    multiply<Scalar>("multiply", n, n, 32);
+                }
+                if (n >= 64) {
+                    sparseMultiply<Scalar>(n);
+                }
+                transposeInPlace<Scalar>(n, n);
+                transposeInto<Scalar>(n, n);
+                if (n >= 16) {
+                    transposeInPlace<Scalar>(n, n / 4);
+                    transposeInto<Scalar>(n, n / 4);
+                }
+                construct<Scalar>(n, n);
+                copyConstruct<Scalar>(n, n);
+                add<Scalar>(n, n);
+            }
+            fixedMultiply<Scalar, 3>();
+            fixedMultiply<Scalar, 4>();
+            batchMultiply<Scalar>(8);
+            batchMultiply<Scalar>(16);
+        }
+
+    private:
+        const Options& options;
+        std::vector<Result> results;
+
+        bool selected(const std::string& name) const {
+            return options.filter.empty() || name.find(options.filter) != std::string::npos;
+        }
+
+        template<typename Scalar>
+        Result makeResult(const std::string& name, int m, int n, int k, double flops, double bytes) const {
+            Result result;
+            result.name = name;
+            result.type = typeName<Scalar>();
+            result.m = m;
+            result.n = n;
+            result.k = k;
+            result.repetitions = 0;
+            result.median_seconds = result.min_seconds = 0.0;
+            result.flops = flops;
+            result.bytes = bytes;
+            return result;
+        }
+
+        // C = A * B (or A^T * B read through a transposed view) into a preallocated m x n matrix.
+        template<typename Scalar>
+        void multiply(const std::string& name, int m, int n, int k, bool transposed_a = false) {
+            if (!selected(name)) {
+                return;
+            }
+            LinearAlgebra::Matrix<Scalar> a(transposed_a ? k : m, transposed_a ? m : k), b(k, n), c(m, n);
+            fillMatrix(a);
+            fillMatrix(b);
+            double bytes = (static_cast<double>(m) * k + static_cast<double>(k) * n + static_cast<double>(m) * n) * sizeof(Scalar);
+            Result result = makeResult<Scalar>(name, m, n, k, 2.0 * m * n * k, bytes);
+            results.push_back(measure(result, options.min_time, [&]() {
+                if (transposed_a) {
+                    c = a.view().transposed() * b;
+                } else {
+                    c = a * b;
+                }
+                benchmark_sink = c.coeff(0);
+            }));
+        }
+
+        // C = A * B with A and B stored in the narrower MixedInputs<Scalar> types and accumulated in Scalar.
+        template<typename Scalar>
+        void multiplyMixed(int n) {
+            std::string name = "multiply_mixed";
+            if (!selected(name)) {
+                return;
+            }
+            typedef typename MixedInputs<Scalar>::left Left;
+            typedef typename MixedInputs<Scalar>::right Right;
+            LinearAlgebra::Matrix<Left> a(n, n);
+            LinearAlgebra::Matrix<Right> b(n, n);
+            LinearAlgebra::Matrix<Scalar> c(n, n);
+            fillMatrix(a);
+            fillMatrix(b);
+            double elements = static_cast<double>(n) * n;
+            Result result = makeResult<Scalar>(name, n, n, n, 2.0 * elements * n,
+                                               elements * (sizeof(Left) + sizeof(Right) + sizeof(Scalar)));
+            results.push_back(measure(result, options.min_time, [&]() {
+                c = a * b;
+                benchmark_sink = c.coeff(0);
+            }));
+        }
+
+        // CSR matrix with 1% nonzeros times a dense n x 64 panel, and times a vector.
+        template<typename Scalar>
+        void sparseMultiply(int n) {
+            if (!selected("sparse_multiply") && !selected("sparse_vector")) {
+                return;
+            }
+            std::vector<LinearAlgebra::SparseEntry<Scalar>> entries;
+            for (std::uint64_t e = 0; e < static_cast<std::uint64_t>(n) * n / 100; ++e) {
+                std::uint64_t hash = (e + 1) * 0x9E3779B97F4A7C15ull;
+                LinearAlgebra::SparseEntry<Scalar> entry = {static_cast<int>((hash >> 16) % n), static_cast<int>((hash >> 40) % n),
+                                                            static_cast<Scalar>(e % 5 + 1)};
+                entries.push_back(entry);
+            }
+            LinearAlgebra::SparseMatrix<Scalar> a(n, n, entries);
+            const double nonzeros = static_cast<double>(a.nonZeros());
+            const double stored = nonzeros * (sizeof(Scalar) + sizeof(int)) + (n + 1.0) * sizeof(std::size_t);
+            if (selected("sparse_multiply")) {
+                const int panel = 64;
+                LinearAlgebra::Matrix<Scalar> b(n, panel), c(n, panel);
+                fillMatrix(b);
+                Result result = makeResult<Scalar>("sparse_multiply", n, panel, n, 2.0 * nonzeros * panel,
+                                                   stored + 2.0 * n * panel * sizeof(Scalar));
+                results.push_back(measure(result, options.min_time, [&]() {
+                    c = a * b;
+                    benchmark_sink = c.coeff(0);
+                }));
+            }
+            if (selected("sparse_vector")) {
+                std::vector<Scalar> x(n, Scalar(1)), y(n);
+                Result result = makeResult<Scalar>("sparse_vector", n, 1, n, 2.0 * nonzeros, stored + 2.0 * n * sizeof(Scalar));
+                results.push_back(measure(result, options.min_time, [&]() {
+                    a.multiply(x.data(), y.data());
+                    benchmark_sink = y[0];
+                }));
+            }
+        }
+
+        template<typename Scalar>
+        void transposeInPlace(int rows, int cols) {
+            if (!selected("transpose_in_place")) {
+                return;
+            }
+            LinearAlgebra::Matrix<Scalar> a(rows, cols);
+            fillMatrix(a);
+            Result result = makeResult<Scalar>("transpose_in_place", rows, cols, 0, 0.0, 2.0 * rows * cols * sizeof(Scalar));
+            results.push_back(measure(result, options.min_time, [&]() {
+                a.transpose();
+                benchmark_sink = a.coeff(1);
+            }));
+        }
+
+        template<typename Scalar>
+        void transposeInto(int rows, int cols) {
+            if (!selected("transpose_into")) {
+                return;
+            }
+            LinearAlgebra::Matrix<Scalar> a(rows, cols), b(cols, rows);
+            fillMatrix(a);
+            Result result = makeResult<Scalar>("transpose_into", rows, cols, 0, 0.0, 2.0 * rows * cols * sizeof(Scalar));
+            results.push_back(measure(result, options.min_time, [&]() {
+                a.transposeInto(b);
+                benchmark_sink = b.coeff(1);
+            }));
+        }
+
+        // Allocation of an uninitialized matrix, i.e. the cost of the storage pool.
+        template<typename Scalar>
+        void construct(int rows, int cols) {
+            if (!selected("construct")) {
+                return;
+            }
+            Result result = makeResult<Scalar>("construct", rows, cols, 0, 0.0, 0.0);
+            results.push_back(measure(result, options.min_time, [&]() {
+                LinearAlgebra::Matrix<Scalar> a(rows, cols);
+                benchmark_sink = a.getRows();
+            }));
+        }
+
+        template<typename Scalar>
+        void copyConstruct(int rows, int cols) {
+            if (!selected("copy_construct")) {
+                return;
+            }
+            LinearAlgebra::Matrix<Scalar> a(rows, cols);
+            fillMatrix(a);
+            Result result = makeResult<Scalar>("copy_construct", rows, cols, 0, 0.0, 2.0 * rows * cols * sizeof(Scalar));
+            results.push_back(measure(result, options.min_time, [&]() {
+                LinearAlgebra::Matrix<Scalar> copy(a);
+                benchmark_sink = copy.coeff(0);
+            }));
+        }
+
+        // Fused elementwise expression evaluated into a preallocated matrix.
+        template<typename Scalar>
+        void add(int rows, int cols) {
+            if (!selected("add")) {
+                return;
+            }
+            LinearAlgebra::Matrix<Scalar> a(rows, cols), b(rows, cols), c(rows, cols);
+            fillMatrix(a);
+            fillMatrix(b);
+            double elements = static_cast<double>(rows) * cols;
+            Result result = makeResult<Scalar>("add", rows, cols, 0, elements, 3.0 * elements * sizeof(Scalar));
+            results.push_back(measure(result, options.min_time, [&]() {
+                c = a + b;
+                benchmark_sink = c.coeff(0);
+            }));
+        }
+
+        // A batch of independent small products, e.g. pose compositions.
+        template<typename Scalar, int N>
+        void fixedMultiply() {
+            std::string name = "fixed_multiply";
+            if (!selected(name)) {
+                return;
+            }
+            const int batch = 4096;
+            typedef LinearAlgebra::FixedMatrix<Scalar, N, N> Fixed;
+            std::vector<Fixed> left(batch), right(batch), product(batch);
+            for (int b = 0; b < batch; ++b) {
+                for (int i = 0; i < N; ++i) {
+                    for (int j = 0; j < N; ++j) {
+                        left[b].set(i, j, static_cast<Scalar>((b + i * 3 + j) % 7 - 3));
+                        right[b].set(i, j, static_cast<Scalar>((b + i + j * 5) % 5 - 2));
+                    }
+                }
+            }
+            Result result = makeResult<Scalar>(name, N, N, N, 2.0 * N * N * N * batch, 3.0 * N * N * batch * sizeof(Scalar));
+            results.push_back(measure(result, options.min_time, [&]() {
+                for (int b = 0; b < batch; ++b) {
+                    product[b] = left[b] * right[b];
+                }
+                benchmark_sink = product[batch - 1].coeff(0);
+            }));
+        }
+
+        // A contiguous batch of independent n x n products through the interleaved batch kernel.
+        template<typename Scalar>
+        void batchMultiply(int n) {
+            std::string name = "batch_multiply";
+            if (!selected(name)) {
+                return;
+            }
+            const int batch = 4096;
+            const std::size_t size = static_cast<std::size_t>(n) * n;
+            std::vector<Scalar> a(batch * size), b(batch * size), c(batch * size);
+            for (std::size_t i = 0; i < a.size(); ++i) {
+                a[i] = static_cast<Scalar>(i % 7) - 3;
+                b[i] = static_cast<Scalar>(i % 5) - 2;
+            }
+            Result result = makeResult<Scalar>(name, n, n, n, 2.0 * n * n * n * batch, 3.0 * size * batch * sizeof(Scalar));
+            results.push_back(measure(result, options.min_time, [&]() {
+                LinearAlgebra::batchMultiply(batch, n, n, n, a.data(), n * n, b.data(), n * n, c.data(), n * n);
+                benchmark_sink = c[size * batch - 1];
+            }));
+        }
+};
+
+/**
+ * Theoretical peak in GFLOP/s for the active SIMD level: two FMA pipes per core, each doing a multiply and an add
+ * per lane, at the clock speed reported by /proc/cpuinfo.
+ * @returns: The peak, or 0 if the clock speed is unknown.
+*/
+double estimatePeakGflops(const std::string& type, int threads) {
+    double mhz = 0.0;
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.compare(0, 7, "cpu MHz") == 0) {
+            mhz = std::atof(line.substr(line.find(':') + 1).c_str());
+            break;
+        }
+    }
+    int vector_bytes = 8;
+    switch (LinearAlgebra::simdLevel()) {
+        case LinearAlgebra::SimdLevel::AVX512: vector_bytes = 64; break;
+        case LinearAlgebra::SimdLevel::AVX2: vector_bytes = 32; break;
+        case LinearAlgebra::SimdLevel::SSE2: vector_bytes = 16; break;
+        default: break;
+    }
+    double lanes = std::max(1.0, static_cast<double>(vector_bytes) / (type == "double" ? 8.0 : 4.0));
+    return mhz * 1e-3 * lanes * 2.0 * 2.0 * threads;
+}
+
+// Bandwidth of a large memcpy in bytes/s, counting both the read and the write.
+double measureBandwidth() {
+    const std::size_t size = 64 << 20;
+    std::vector<char> source(size, 1), destination(size);
+    typedef std::chrono::steady_clock Clock;
+    double best = 1e30;
+    for (int i = 0; i < 5; ++i) {
+        Clock::time_point start = Clock::now();
+        std::memcpy(destination.data(), source.data(), size);
+        best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+    }
+    benchmark_sink = destination[size / 2];
+    return 2.0 * size / best;
+}
+
+double percentOfPeak(const Result& result, const Options& options, double bandwidth) {
+    if (result.median_seconds <= 0.0) {
+        return 0.0;
+    }
+    bool compute_bound = result.name.find("multiply") != std::string::npos;
+    if (compute_bound) {
+        double peak = options.peak_gflops > 0.0 ? options.peak_gflops : estimatePeakGflops(result.type, options.threads);
+        return peak > 0.0 ? 100.0 * result.flops / result.median_seconds * 1e-9 / peak : 0.0;
+    }
+    return bandwidth > 0.0 && result.bytes > 0.0 ? 100.0 * result.bytes / result.median_seconds / bandwidth : 0.0;
+}
+
+void writeTable(std::ostream& os, const std::vector<Result>& results, const Options& options, double bandwidth) {
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-22s %-6s %6s %6s %6s %6s %12s %10s %10s %7s\n", "name", "type", "m", "n", "k",
+                  "reps", "median_us", "GFLOP/s", "GB/s", "%peak");
+    os << line;
+    for (const Result& result : results) {
+        std::snprintf(line, sizeof(line), "%-22s %-6s %6d %6d %6d %6d %12.3f %10.3f %10.3f %7.1f\n",
+                      result.name.c_str(), result.type.c_str(), result.m, result.n, result.k, result.repetitions,
+                      result.median_seconds * 1e6, result.flops / result.median_seconds * 1e-9,
+                      result.bytes / result.median_seconds * 1e-9, percentOfPeak(result, options, bandwidth));
+        os << line;
+    }
+}
+
+void writeCsv(std::ostream& os, const std::vector<Result>& results, const Options& options, double bandwidth) {
+    os << "name,type,m,n,k,threads,repetitions,median_seconds,min_seconds,gflops,bytes_per_second,percent_of_peak\n";
+    for (const Result& result : results) {
+        os << result.name << "," << result.type << "," << result.m << "," << result.n << "," << result.k << ","
+           << options.threads << "," << result.repetitions << "," << result.median_seconds << "," << result.min_seconds
+           << "," << result.flops / result.median_seconds * 1e-9 << "," << result.bytes / result.median_seconds << ","
+           << percentOfPeak(result, options, bandwidth) << "\n";
+    }
+}
+
+void writeJson(std::ostream& os, const std::vector<Result>& results, const Options& options, double bandwidth) {
+    os << "{\n  \"machine\": {\"simd\": \"" << simdLevelName(LinearAlgebra::simdLevel()) << "\", \"threads\": "
+       << options.threads << ", \"peak_gflops_double\": "
+       << (options.peak_gflops > 0.0 ? options.peak_gflops : estimatePeakGflops("double", options.threads))
+       << ", \"peak_gflops_float\": "
+       << (options.peak_gflops > 0.0 ? options.peak_gflops : estimatePeakGflops("float", options.threads))
+       << ", \"bandwidth_bytes_per_second\": " << bandwidth << "},\n  \"results\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        os << "    {\"name\": \"" << result.name << "\", \"type\": \"" << result.type << "\", \"m\": " << result.m
+           << ", \"n\": " << result.n << ", \"k\": " << result.k << ", \"repetitions\": " << result.repetitions
+           << ", \"median_seconds\": " << result.median_seconds << ", \"min_seconds\": " << result.min_seconds
+           << ", \"gflops\": " << result.flops / result.median_seconds * 1e-9
+           << ", \"bytes_per_second\": " << result.bytes / result.median_seconds
+           << ", \"percent_of_peak\": " << percentOfPeak(result, options, bandwidth) << "}"
+           << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n}\n";
+}
+
+std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << argument << "\n";
+            return false;
+        }
+        std::string value = argv[++i];
+        if (argument == "--format") {
+            options.format = value;
+        } else if (argument == "--output") {
+            options.output = value;
+        } else if (argument == "--max-size") {
+            options.max_size = std::atoi(value.c_str());
+        } else if (argument == "--sizes") {
+            for (const std::string& size : splitList(value)) {
+                options.sizes.push_back(std::atoi(size.c_str()));
+            }
+        } else if (argument == "--types") {
+            options.types = splitList(value);
+        } else if (argument == "--filter") {
+            options.filter = value;
+        } else if (argument == "--min-time") {
+            options.min_time = std::atof(value.c_str());
+        } else if (argument == "--threads") {
+            options.threads = std::max(1, std::atoi(value.c_str()));
+        } else if (argument == "--peak-gflops") {
+            options.peak_gflops = std::atof(value.c_str());
+        } else if (argument == "--peak-bandwidth") {
+            options.peak_bandwidth = std::atof(value.c_str()) * 1e9;
+        } else {
+            std::cerr << "Unknown option " << argument << "\n";
+            return false;
+        }
+    }
+    if (options.format != "table" && options.format != "json" && options.format != "csv") {
+        std::cerr << "Unknown format " << options.format << "\n";
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " [--format table|json|csv] [--output FILE] [--max-size N]"
+                  << " [--sizes N,N,...] [--types double,float,int] [--filter SUBSTRING] [--min-time SECONDS]"
+                  << " [--threads N] [--peak-gflops X] [--peak-bandwidth GBPS]\n";
+        return 1;
+    }
+    LinearAlgebra::setNumThreads(options.threads);
+
+    Runner runner(options);
+    for (const std::string& type : options.types) {
+        if (type == "double") {
+            runner.runType<double>();
+        } else if (type == "float") {
+            runner.runType<float>();
+        } else if (type == "int") {
+            runner.runType<int>();
+        } else {
+            std::cerr << "Unknown type " << type << "\n";
+            return 1;
+        }
+    }
+    double bandwidth = options.peak_bandwidth > 0.0 ? options.peak_bandwidth : measureBandwidth();
+
+    std::ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output.c_str());
+        if (!file) {
+            std::cerr << "Cannot open " << options.output << "\n";
+            return 1;
+        }
+    }
+    std::ostream& os = options.output.empty() ? std::cout : file;
+    if (options.format == "json") {
+        writeJson(os, runner.getResults(), options, bandwidth);
+    } else if (options.format == "csv") {
+        writeCsv(os, runner.getResults(), options, bandwidth);
+    } else {
+        writeTable(os, runner.getResults(), options, bandwidth);
+    }
+    return 0;
+}
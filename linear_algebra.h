@@ -11,249 +11,5604 @@
 #include <vector>
 #include <initializer_list>
 #include <stdexcept>
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <limits>
+#include <locale>
+#include <future>
+#include <cmath>
+#include <iterator>
+#include <chrono>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
 
+// Binary matrix files are opened with mmap where it is available and read into memory elsewhere.
+#if defined(__unix__) || defined(__APPLE__)
+#define LINEAR_ALGEBRA_HAS_MMAP 1
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#define LINEAR_ALGEBRA_HAS_MMAP 0
+#endif
+
+// operator() and the row / column spans check their indices only in debug builds (NDEBUG not defined), so that hot
+// loops carry no branch per element in release builds; at(), get() and set() always check. Define
+// LINEAR_ALGEBRA_CHECK_BOUNDS to 0 or 1 to override.
+#ifndef LINEAR_ALGEBRA_CHECK_BOUNDS
+#ifdef NDEBUG
+#define LINEAR_ALGEBRA_CHECK_BOUNDS 0
+#else
+#define LINEAR_ALGEBRA_CHECK_BOUNDS 1
+#endif
+#endif
+
+// Define LINEAR_ALGEBRA_INSTRUMENTATION (e.g. -DLINEAR_ALGEBRA_INSTRUMENTATION) to count calls, FLOPs, bytes and wall time
+// of the library's operations, see instrumentationSnapshot(). Without it the hooks expand to nothing. On Linux the
+// instrumented build can also read perf_event hardware counters, see enableHardwareCounters().
+#ifndef LINEAR_ALGEBRA_INSTRUMENTATION
+#define LINEAR_ALGEBRA_INSTRUMENTATION 0
+#endif
+#if LINEAR_ALGEBRA_INSTRUMENTATION && defined(__linux__)
+#define LINEAR_ALGEBRA_HAS_PERF_EVENT 1
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#define LINEAR_ALGEBRA_HAS_PERF_EVENT 0
+#endif
+
+// Explicit SIMD kernels are compiled for x86 with GCC/Clang through per-function target attributes, so the rest of the
+// library can be built without any -m flags and the widest instruction set is picked at runtime.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define LINEAR_ALGEBRA_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define LINEAR_ALGEBRA_X86_SIMD 0
+#endif
+
+/**
+ * The Linear Algebra library currently contains a Matrix class with its associated constructors, some overloaded operators,
+ * getters & setters, and two primary methods:
+ * 
+ * 1) A multiplication method, implemented via the overloaded "*" operator
+ * 2) A transpose method
+ * 
+ * The primary implementation of the Matrix itself is via the use of a C style contiguos array, instead of the more
+ * straightforward nested vector implementation. This allows for slightly better access times and performance. 
+ * This "flattened" matrix is accessed and manipulated with the member methods of the Matrix class. The Matrix is also
+ * 0-indexed based with a getter and setter for accessing elements.
+*/
+namespace LinearAlgebra {
+
+// Instruction sets the SIMD kernels are available for, in increasing order of width.
+enum class SimdLevel { Scalar = 0, SSE2 = 1, AVX2 = 2, AVX512 = 3 };
+
+/**
+ * bfloat16 storage type: the upper 16 bits of a float (8 exponent bits, 7 mantissa bits). A Matrix<BFloat16> takes half
+ * the memory and bandwidth of a Matrix<float>; values convert implicitly to and from float, and all arithmetic on them,
+ * including products, is done in float (see ComputeType).
+*/
+class BFloat16
+{
+   private:
+      std::uint16_t bits;
+
+   public:
+      BFloat16() : bits(0) {}
+
+      // Rounds to the nearest bfloat16, ties to even. NaNs stay NaN.
+      BFloat16(float value) {
+         std::uint32_t word;
+         std::memcpy(&word, &value, sizeof(word));
+         if ((word & 0x7fffffffu) > 0x7f800000u) {
+            bits = static_cast<std::uint16_t>((word >> 16) | 0x40u);
+         } else {
+            bits = static_cast<std::uint16_t>((word + 0x7fffu + ((word >> 16) & 1u)) >> 16);
+         }
+      }
+
+      operator float() const {
+         std::uint32_t word = static_cast<std::uint32_t>(bits) << 16;
+         float value;
+         std::memcpy(&value, &word, sizeof(value));
+         return value;
+      }
+
+      std::uint16_t toBits() const { return bits; }
+
+      static BFloat16 fromBits(std::uint16_t input_bits) {
+         BFloat16 result;
+         result.bits = input_bits;
+         return result;
+      }
+};
+
+/**
+ * IEEE 754 half precision storage type (5 exponent bits, 10 mantissa bits, largest finite value 65504). Like BFloat16
+ * it converts implicitly to and from float and is computed with in float.
+*/
+class Float16
+{
+   private:
+      std::uint16_t bits;
+
+   public:
+      Float16() : bits(0) {}
+
+      // Rounds to the nearest half, ties to even. Values beyond the half range become infinity.
+      Float16(float value) {
+         std::uint32_t word;
+         std::memcpy(&word, &value, sizeof(word));
+         std::uint32_t sign = (word >> 16) & 0x8000u;
+         std::uint32_t magnitude = word & 0x7fffffffu;
+         if (magnitude > 0x7f800000u) {
+            bits = static_cast<std::uint16_t>(sign | 0x7e00u);
+         } else if (magnitude >= 0x477ff000u) {
+            bits = static_cast<std::uint16_t>(sign | 0x7c00u);
+         } else if (magnitude < 0x38800000u) {
+            // Subnormal half: the value in units of 2^-24, rounded in the current (nearest even) rounding mode.
+            bits = static_cast<std::uint16_t>(sign | static_cast<std::uint32_t>(std::nearbyint(std::fabs(value) * 16777216.0f)));
+         } else {
+            bits = static_cast<std::uint16_t>(sign | ((magnitude + 0xfffu + ((magnitude >> 13) & 1u) - 0x38000000u) >> 13));
+         }
+      }
+
+      operator float() const {
+         std::uint32_t sign = static_cast<std::uint32_t>(bits & 0x8000u) << 16;
+         std::uint32_t exponent = (bits >> 10) & 0x1fu;
+         std::uint32_t mantissa = bits & 0x3ffu;
+         if (exponent == 0) {
+            float value = static_cast<float>(mantissa) * 5.9604644775390625e-8f;
+            return sign ? -value : value;
+         }
+         std::uint32_t word = sign | (exponent == 0x1fu ? 0x7f800000u : (exponent + 112) << 23) | (mantissa << 13);
+         float value;
+         std::memcpy(&value, &word, sizeof(value));
+         return value;
+      }
+
+      std::uint16_t toBits() const { return bits; }
+
+      static Float16 fromBits(std::uint16_t input_bits) {
+         Float16 result;
+         result.bits = input_bits;
+         return result;
+      }
+};
+
+/**
+ * Type that arithmetic on a Scalar is carried out in: the Scalar itself, except for the 16-bit storage types, which
+ * compute in float.
+*/
+template<typename Scalar>
+struct ComputeType {
+   typedef Scalar type;
+};
+
+template<>
+struct ComputeType<BFloat16> {
+   typedef float type;
+};
+
+template<>
+struct ComputeType<Float16> {
+   typedef float type;
+};
+
+/**
+ * Scalar type of the product of a Matrix<Left> and a Matrix<Right>, which is also the type its dot products are
+ * accumulated in. It follows the usual C++ arithmetic conversions of the compute types, so int8_t and int16_t inputs
+ * accumulate in int, int times double gives double, float times double gives double and BFloat16 or Float16 inputs
+ * give float. Decided at compile time; specialize it to pick a different accumulator for a pair of types.
+*/
+template<typename Left, typename Right>
+struct ProductScalar {
+   typedef typename std::decay<decltype(std::declval<typename ComputeType<Left>::type>() *
+                                        std::declval<typename ComputeType<Right>::type>())>::type type;
+};
+
+namespace detail {
+
+/**
+ * Blocking parameters for the packed GEMM kernel.
+ *
+ * MR x NR is the register tile computed by the micro-kernel, KC is the depth of a packed panel (an MR x KC sliver of A
+ * plus a KC x NR sliver of B should stay in L1), MC x KC is the packed block of A kept in L2 and KC x NC is the packed
+ * panel of B kept in L3. Scalar types that are not arithmetic (user defined number types etc.) are not packed and use
+ * the plain loop fallback instead.
+*/
+template<typename Scalar>
+struct GemmBlocking {
+   static const bool packed = std::is_arithmetic<Scalar>::value;
+   static const int MR = 4;
+   static const int NR = 4;
+   static const int MC = 64;
+   static const int KC = 256;
+   static const int NC = 1024;
+};
+
+template<>
+struct GemmBlocking<double> {
+   static const bool packed = true;
+   static const int MR = 4;
+   static const int NR = 8;
+   static const int MC = 96;
+   static const int KC = 256;
+   static const int NC = 2048;
+};
+
+template<>
+struct GemmBlocking<int> {
+   static const bool packed = true;
+   static const int MR = 4;
+   static const int NR = 8;
+   static const int MC = 96;
+   static const int KC = 384;
+   static const int NC = 2048;
+};
+
+template<>
+struct GemmBlocking<float> {
+   static const bool packed = true;
+   static const int MR = 4;
+   static const int NR = 16;
+   static const int MC = 96;
+   static const int KC = 384;
+   static const int NC = 2048;
+};
+
+/**
+ * Returns a per-thread scratch buffer with room for at least "size" elements. The buffer only ever grows, so the
+ * packing buffers of the GEMM kernel are allocated once per thread instead of once per multiplication.
+ * @param slot: Index of the buffer, so that a caller can hold several scratch buffers at the same time.
+ * @param size: Minimum number of elements required.
+*/
+template<typename Scalar, int slot>
+Scalar* scratchBuffer(std::size_t size) {
+   thread_local std::vector<Scalar> buffer;
+   if (buffer.size() < size) {
+      buffer.resize(size);
+   }
+   return buffer.data();
+}
+
+/**
+ * Packs an mc x kc block of A into consecutive MR-row slivers. Within a sliver the MR values of one column are
+ * contiguous, which is the order the micro-kernel consumes them in. Rows past mc are zero padded.
+ * The block is addressed through a row stride and a column stride so that a transposed operand can be packed directly.
+ * Elements of another type (e.g. int8_t or BFloat16) are converted to Scalar here, once per packed block, so the
+ * micro-kernel only ever sees its own type.
+*/
+template<typename Scalar, int MR, typename Source>
+void packA(int mc, int kc, const Source* a, std::ptrdiff_t rs_a, std::ptrdiff_t cs_a, Scalar* packed) {
+   for (int i = 0; i < mc; i += MR) {
+      int mr = std::min(MR, mc - i);
+      const Source* a_sliver = a + i * rs_a;
+      for (int p = 0; p < kc; ++p) {
+         int r = 0;
+         for (; r < mr; ++r) {
+            packed[r] = static_cast<Scalar>(a_sliver[r * rs_a + p * cs_a]);
+         }
+         for (; r < MR; ++r) {
+            packed[r] = Scalar(0);
+         }
+         packed += MR;
+      }
+   }
+}
+
+/**
+ * Packs a kc x nc panel of B into consecutive NR-column slivers. Within a sliver the NR values of one row are
+ * contiguous. Columns past nc are zero padded. Converts to Scalar like packA().
+*/
+template<typename Scalar, int NR, typename Source>
+void packB(int kc, int nc, const Source* b, std::ptrdiff_t rs_b, std::ptrdiff_t cs_b, Scalar* packed) {
+   for (int j = 0; j < nc; j += NR) {
+      int nr = std::min(NR, nc - j);
+      const Source* b_sliver = b + j * cs_b;
+      for (int p = 0; p < kc; ++p) {
+         const Source* b_row = b_sliver + p * rs_b;
+         int c = 0;
+         for (; c < nr; ++c) {
+            packed[c] = static_cast<Scalar>(b_row[c * cs_b]);
+         }
+         for (; c < NR; ++c) {
+            packed[c] = Scalar(0);
+         }
+         packed += NR;
+      }
+   }
+}
+
+/**
+ * Scales the m x n row-major block C by beta. A beta of zero overwrites C with zeros rather than multiplying,
+ * so uninitialized memory (NaN etc.) never leaks into the result.
+*/
+template<typename Scalar>
+void scaleBlock(int m, int n, Scalar beta, Scalar* c, std::ptrdiff_t ldc) {
+   if (beta == Scalar(1)) {
+      return;
+   }
+   for (int i = 0; i < m; ++i) {
+      Scalar* c_row = c + i * ldc;
+      if (beta == Scalar(0)) {
+         std::fill(c_row, c_row + n, Scalar(0));
+      } else {
+         for (int j = 0; j < n; ++j) {
+            c_row[j] *= beta;
+         }
+      }
+   }
+}
+
+// Plain i-k-j loop used for Scalar types that are not packed.
+template<typename Scalar, typename LeftScalar, typename RightScalar>
+void gemmReference(int m, int n, int k, Scalar alpha,
+                   const LeftScalar* a, std::ptrdiff_t rs_a, std::ptrdiff_t cs_a,
+                   const RightScalar* b, std::ptrdiff_t rs_b, std::ptrdiff_t cs_b,
+                   Scalar* c, std::ptrdiff_t ldc) {
+   for (int i = 0; i < m; ++i) {
+      Scalar* c_row = c + i * ldc;
+      for (int p = 0; p < k; ++p) {
+         const Scalar a_value = alpha * static_cast<Scalar>(a[i * rs_a + p * cs_a]);
+         const RightScalar* b_row = b + p * rs_b;
+         for (int j = 0; j < n; ++j) {
+            c_row[j] += a_value * static_cast<Scalar>(b_row[j * cs_b]);
+         }
+      }
+   }
+}
+
+/**
+ * Adds alpha * tile into the mr x nr corner of the row-major block C. Shared by every micro-kernel, the SIMD kernels
+ * spill their accumulators into "tile" once per kc iterations so this write back is off the hot path.
+*/
+template<typename Scalar, int MR, int NR>
+inline void accumulateTile(const Scalar* tile, Scalar alpha, Scalar* c, std::ptrdiff_t ldc, int mr, int nr) {
+   for (int i = 0; i < mr; ++i) {
+      for (int j = 0; j < nr; ++j) {
+         c[i * ldc + j] += alpha * tile[i * NR + j];
+      }
+   }
+}
+
+/**
+ * Register-blocked micro-kernel: C[0:mr, 0:nr] += alpha * (packed A sliver) * (packed B sliver).
+ * The full MR x NR tile is always accumulated (the packed slivers are zero padded), only the write back is clipped.
+*/
+template<typename Scalar, int MR, int NR>
+void microKernel(int kc, const Scalar* a, const Scalar* b, Scalar alpha, Scalar* c, std::ptrdiff_t ldc, int mr, int nr) {
+   Scalar acc[MR * NR];
+   for (int i = 0; i < MR * NR; ++i) {
+      acc[i] = Scalar(0);
+   }
+   for (int p = 0; p < kc; ++p) {
+      for (int i = 0; i < MR; ++i) {
+         const Scalar a_value = a[i];
+         for (int j = 0; j < NR; ++j) {
+            acc[i * NR + j] += a_value * b[j];
+         }
+      }
+      a += MR;
+      b += NR;
+   }
+   accumulateTile<Scalar, MR, NR>(acc, alpha, c, ldc, mr, nr);
+}
+
+/**
+ * Edge length of the square tile handled by the transpose tile kernels. Chosen so that one tile row fills a 256-bit
+ * register for 4 and 8 byte types.
+*/
+template<typename Scalar>
+struct TransposeTile {
+   static const int size = sizeof(Scalar) == 4 ? 8 : 4;
+};
+
+// Transposes one TransposeTile<Scalar>::size square tile from src (row stride lds) into dst (row stride ldd).
+template<typename Scalar>
+void transposeTile(const Scalar* src, std::ptrdiff_t lds, Scalar* dst, std::ptrdiff_t ldd) {
+   const int T = TransposeTile<Scalar>::size;
+   for (int i = 0; i < T; ++i) {
+      for (int j = 0; j < T; ++j) {
+         dst[j * ldd + i] = src[i * lds + j];
+      }
+   }
+}
+
+// Elementwise kernels over n contiguous elements. The SIMD versions below have the same signatures.
+template<typename Scalar>
+void addKernel(std::size_t n, const Scalar* x, const Scalar* y, Scalar* out) {
+   for (std::size_t i = 0; i < n; ++i) out[i] = x[i] + y[i];
+}
+
+template<typename Scalar>
+void subtractKernel(std::size_t n, const Scalar* x, const Scalar* y, Scalar* out) {
+   for (std::size_t i = 0; i < n; ++i) out[i] = x[i] - y[i];
+}
+
+template<typename Scalar>
+void multiplyKernel(std::size_t n, const Scalar* x, const Scalar* y, Scalar* out) {
+   for (std::size_t i = 0; i < n; ++i) out[i] = x[i] * y[i];
+}
+
+// out = alpha * x
+template<typename Scalar>
+void scaleKernel(std::size_t n, Scalar alpha, const Scalar* x, Scalar* out) {
+   for (std::size_t i = 0; i < n; ++i) out[i] = alpha * x[i];
+}
+
+// y += alpha * x
+template<typename Scalar>
+void axpyKernel(std::size_t n, Scalar alpha, const Scalar* x, Scalar* y) {
+   for (std::size_t i = 0; i < n; ++i) y[i] += alpha * x[i];
+}
+
+/**
+ * Number of matrices a batched multiplication interleaves: element (i, j) of BatchWidth consecutive matrices of a
+ * batch is stored contiguously, one cache line wide, so a single vector operation works on the same element of
+ * every matrix in the group.
+*/
+template<typename Scalar>
+struct BatchWidth {
+   static const int value = sizeof(Scalar) >= 64 ? 1 : static_cast<int>(64 / sizeof(Scalar));
+};
+
+/**
+ * C = A * B for BatchWidth<Scalar> interleaved m x k and k x n matrices at once (see batchMultiply()). Four columns
+ * of C are accumulated at a time; every statement of the innermost loop is a loop over the width of the group.
+*/
+template<typename Scalar>
+void batchKernel(int m, int n, int k, const Scalar* a, const Scalar* b, Scalar* c) {
+   const int W = BatchWidth<Scalar>::value;
+   for (int i = 0; i < m; ++i) {
+      int j = 0;
+      for (; j + 4 <= n; j += 4) {
+         Scalar acc[4][W];
+         for (int jj = 0; jj < 4; ++jj) for (int w = 0; w < W; ++w) acc[jj][w] = Scalar(0);
+         for (int p = 0; p < k; ++p) {
+            const Scalar* a_lanes = a + (static_cast<std::ptrdiff_t>(i) * k + p) * W;
+            const Scalar* b_lanes = b + (static_cast<std::ptrdiff_t>(p) * n + j) * W;
+            for (int jj = 0; jj < 4; ++jj) {
+               for (int w = 0; w < W; ++w) acc[jj][w] += a_lanes[w] * b_lanes[jj * W + w];
+            }
+         }
+         Scalar* c_lanes = c + (static_cast<std::ptrdiff_t>(i) * n + j) * W;
+         for (int jj = 0; jj < 4; ++jj) for (int w = 0; w < W; ++w) c_lanes[jj * W + w] = acc[jj][w];
+      }
+      for (; j < n; ++j) {
+         Scalar acc[W];
+         for (int w = 0; w < W; ++w) acc[w] = Scalar(0);
+         for (int p = 0; p < k; ++p) {
+            const Scalar* a_lanes = a + (static_cast<std::ptrdiff_t>(i) * k + p) * W;
+            const Scalar* b_lanes = b + (static_cast<std::ptrdiff_t>(p) * n + j) * W;
+            for (int w = 0; w < W; ++w) acc[w] += a_lanes[w] * b_lanes[w];
+         }
+         Scalar* c_lanes = c + (static_cast<std::ptrdiff_t>(i) * n + j) * W;
+         for (int w = 0; w < W; ++w) c_lanes[w] = acc[w];
+      }
+   }
+}
+
+/**
+ * Table of the kernels selected for one Scalar type and one instruction set. Every entry starts out as the portable
+ * C++ version and is replaced by an intrinsic version where one exists for the requested SimdLevel.
+*/
+template<typename Scalar>
+struct KernelTable {
+   void (*micro_kernel)(int, const Scalar*, const Scalar*, Scalar, Scalar*, std::ptrdiff_t, int, int);
+   void (*transpose_tile)(const Scalar*, std::ptrdiff_t, Scalar*, std::ptrdiff_t);
+   void (*add)(std::size_t, const Scalar*, const Scalar*, Scalar*);
+   void (*subtract)(std::size_t, const Scalar*, const Scalar*, Scalar*);
+   void (*multiply)(std::size_t, const Scalar*, const Scalar*, Scalar*);
+   void (*scale)(std::size_t, Scalar, const Scalar*, Scalar*);
+   void (*axpy)(std::size_t, Scalar, const Scalar*, Scalar*);
+   void (*batch_kernel)(int, int, int, const Scalar*, const Scalar*, Scalar*);
+};
+
+template<typename Scalar>
+KernelTable<Scalar> portableKernels() {
+   KernelTable<Scalar> table;
+   table.micro_kernel = &microKernel<Scalar, GemmBlocking<Scalar>::MR, GemmBlocking<Scalar>::NR>;
+   table.transpose_tile = &transposeTile<Scalar>;
+   table.add = &addKernel<Scalar>;
+   table.subtract = &subtractKernel<Scalar>;
+   table.multiply = &multiplyKernel<Scalar>;
+   table.scale = &scaleKernel<Scalar>;
+   table.axpy = &axpyKernel<Scalar>;
+   table.batch_kernel = &batchKernel<Scalar>;
+   return table;
+}
+
+// Only the portable kernels exist for Scalar types without a specialization below.
+template<typename Scalar>
+KernelTable<Scalar> buildKernelTable(SimdLevel) {
+   return portableKernels<Scalar>();
+}
+
+#if LINEAR_ALGEBRA_X86_SIMD
+
+#define LINEAR_ALGEBRA_TARGET(isa) __attribute__((target(isa)))
+
+// --- GEMM micro-kernels (4 x 8 for double, 4 x 16 for float, 4 x 8 for int) ---
+
+LINEAR_ALGEBRA_TARGET("sse2")
+inline void microKernelSse2(int kc, const double* a, const double* b, double alpha, double* c, std::ptrdiff_t ldc, int mr, int nr) {
+   __m128d acc[4][4];
+   for (int i = 0; i < 4; ++i) for (int j = 0; j < 4; ++j) acc[i][j] = _mm_setzero_pd();
+   for (int p = 0; p < kc; ++p) {
+      __m128d b_vec[4];
+      for (int j = 0; j < 4; ++j) b_vec[j] = _mm_loadu_pd(b + 2 * j);
+      for (int i = 0; i < 4; ++i) {
+         __m128d a_vec = _mm_set1_pd(a[i]);
+         for (int j = 0; j < 4; ++j) acc[i][j] = _mm_add_pd(acc[i][j], _mm_mul_pd(a_vec, b_vec[j]));
+      }
+      a += 4;
+      b += 8;
+   }
+   double tile[32];
+   for (int i = 0; i < 4; ++i) for (int j = 0; j < 4; ++j) _mm_storeu_pd(tile + i * 8 + 2 * j, acc[i][j]);
+   accumulateTile<double, 4, 8>(tile, alpha, c, ldc, mr, nr);
+}
+
+LINEAR_ALGEBRA_TARGET("sse2")
+inline void microKernelSse2(int kc, const float* a, const float* b, float alpha, float* c, std::ptrdiff_t ldc, int mr, int nr) {
+   __m128 acc[4][4];
+   for (int i = 0; i < 4; ++i) for (int j = 0; j < 4; ++j) acc[i][j] = _mm_setzero_ps();
+   for (int p = 0; p < kc; ++p) {
+      __m128 b_vec[4];
+      for (int j = 0; j < 4; ++j) b_vec[j] = _mm_loadu_ps(b + 4 * j);
+      for (int i = 0; i < 4; ++i) {
+         __m128 a_vec = _mm_set1_ps(a[i]);
+         for (int j = 0; j < 4; ++j) acc[i][j] = _mm_add_ps(acc[i][j], _mm_mul_ps(a_vec, b_vec[j]));
+      }
+      a += 4;
+      b += 16;
+   }
+   float tile[64];
+   for (int i = 0; i < 4; ++i) for (int j = 0; j < 4; ++j) _mm_storeu_ps(tile + i * 16 + 4 * j, acc[i][j]);
+   accumulateTile<float, 4, 16>(tile, alpha, c, ldc, mr, nr);
+}
+
+LINEAR_ALGEBRA_TARGET("avx2,fma")
+inline void microKernelAvx2(int kc, const double* a, const double* b, double alpha, double* c, std::ptrdiff_t ldc, int mr, int nr) {
+   __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+   __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+   __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+   __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+   for (int p = 0; p < kc; ++p) {
+      __m256d b0 = _mm256_loadu_pd(b), b1 = _mm256_loadu_pd(b + 4);
+      __m256d a_vec = _mm256_broadcast_sd(a);
+      c00 = _mm256_fmadd_pd(a_vec, b0, c00); c01 = _mm256_fmadd_pd(a_vec, b1, c01);
+      a_vec = _mm256_broadcast_sd(a + 1);
+      c10 = _mm256_fmadd_pd(a_vec, b0, c10); c11 = _mm256_fmadd_pd(a_vec, b1, c11);
+      a_vec = _mm256_broadcast_sd(a + 2);
+      c20 = _mm256_fmadd_pd(a_vec, b0, c20); c21 = _mm256_fmadd_pd(a_vec, b1, c21);
+      a_vec = _mm256_broadcast_sd(a + 3);
+      c30 = _mm256_fmadd_pd(a_vec, b0, c30); c31 = _mm256_fmadd_pd(a_vec, b1, c31);
+      a += 4;
+      b += 8;
+   }
+   double tile[32];
+   _mm256_storeu_pd(tile, c00);      _mm256_storeu_pd(tile + 4, c01);
+   _mm256_storeu_pd(tile + 8, c10);  _mm256_storeu_pd(tile + 12, c11);
+   _mm256_storeu_pd(tile + 16, c20); _mm256_storeu_pd(tile + 20, c21);
+   _mm256_storeu_pd(tile + 24, c30); _mm256_storeu_pd(tile + 28, c31);
+   accumulateTile<double, 4, 8>(tile, alpha, c, ldc, mr, nr);
+}
+
+LINEAR_ALGEBRA_TARGET("avx2,fma")
+inline void microKernelAvx2(int kc, const float* a, const float* b, float alpha, float* c, std::ptrdiff_t ldc, int mr, int nr) {
+   __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+   __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+   __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+   __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+   for (int p = 0; p < kc; ++p) {
+      __m256 b0 = _mm256_loadu_ps(b), b1 = _mm256_loadu_ps(b + 8);
+      __m256 a_vec = _mm256_broadcast_ss(a);
+      c00 = _mm256_fmadd_ps(a_vec, b0, c00); c01 = _mm256_fmadd_ps(a_vec, b1, c01);
+      a_vec = _mm256_broadcast_ss(a + 1);
+      c10 = _mm256_fmadd_ps(a_vec, b0, c10); c11 = _mm256_fmadd_ps(a_vec, b1, c11);
+      a_vec = _mm256_broadcast_ss(a + 2);
+      c20 = _mm256_fmadd_ps(a_vec, b0, c20); c21 = _mm256_fmadd_ps(a_vec, b1, c21);
+      a_vec = _mm256_broadcast_ss(a + 3);
+      c30 = _mm256_fmadd_ps(a_vec, b0, c30); c31 = _mm256_fmadd_ps(a_vec, b1, c31);
+      a += 4;
+      b += 16;
+   }
+   float tile[64];
+   _mm256_storeu_ps(tile, c00);      _mm256_storeu_ps(tile + 8, c01);
+   _mm256_storeu_ps(tile + 16, c10); _mm256_storeu_ps(tile + 24, c11);
+   _mm256_storeu_ps(tile + 32, c20); _mm256_storeu_ps(tile + 40, c21);
+   _mm256_storeu_ps(tile + 48, c30); _mm256_storeu_ps(tile + 56, c31);
+   accumulateTile<float, 4, 16>(tile, alpha, c, ldc, mr, nr);
+}
+
+LINEAR_ALGEBRA_TARGET("avx2")
+inline void microKernelAvx2(int kc, const int* a, const int* b, int alpha, int* c, std::ptrdiff_t ldc, int mr, int nr) {
+   __m256i c0 = _mm256_setzero_si256(), c1 = _mm256_setzero_si256();
+   __m256i c2 = _mm256_setzero_si256(), c3 = _mm256_setzero_si256();
+   for (int p = 0; p < kc; ++p) {
+      __m256i b_vec = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+      c0 = _mm256_add_epi32(c0, _mm256_mullo_epi32(_mm256_set1_epi32(a[0]), b_vec));
+      c1 = _mm256_add_epi32(c1, _mm256_mullo_epi32(_mm256_set1_epi32(a[1]), b_vec));
+      c2 = _mm256_add_epi32(c2, _mm256_mullo_epi32(_mm256_set1_epi32(a[2]), b_vec));
+      c3 = _mm256_add_epi32(c3, _mm256_mullo_epi32(_mm256_set1_epi32(a[3]), b_vec));
+      a += 4;
+      b += 8;
+   }
+   int tile[32];
+   _mm256_storeu_si256(reinterpret_cast<__m256i*>(tile), c0);
+   _mm256_storeu_si256(reinterpret_cast<__m256i*>(tile + 8), c1);
+   _mm256_storeu_si256(reinterpret_cast<__m256i*>(tile + 16), c2);
+   _mm256_storeu_si256(reinterpret_cast<__m256i*>(tile + 24), c3);
+   accumulateTile<int, 4, 8>(tile, alpha, c, ldc, mr, nr);
+}
+
+LINEAR_ALGEBRA_TARGET("avx512f")
+inline void microKernelAvx512(int kc, const double* a, const double* b, double alpha, double* c, std::ptrdiff_t ldc, int mr, int nr) {
+   __m512d c0 = _mm512_setzero_pd(), c1 = _mm512_setzero_pd(), c2 = _mm512_setzero_pd(), c3 = _mm512_setzero_pd();
+   for (int p = 0; p < kc; ++p) {
+      __m512d b_vec = _mm512_loadu_pd(b);
+      c0 = _mm512_fmadd_pd(_mm512_set1_pd(a[0]), b_vec, c0);
+      c1 = _mm512_fmadd_pd(_mm512_set1_pd(a[1]), b_vec, c1);
+      c2 = _mm512_fmadd_pd(_mm512_set1_pd(a[2]), b_vec, c2);
+      c3 = _mm512_fmadd_pd(_mm512_set1_pd(a[3]), b_vec, c3);
+      a += 4;
+      b += 8;
+   }
+   double tile[32];
+   _mm512_storeu_pd(tile, c0); _mm512_storeu_pd(tile + 8, c1); _mm512_storeu_pd(tile + 16, c2); _mm512_storeu_pd(tile + 24, c3);
+   accumulateTile<double, 4, 8>(tile, alpha, c, ldc, mr, nr);
+}
+
+LINEAR_ALGEBRA_TARGET("avx512f")
+inline void microKernelAvx512(int kc, const float* a, const float* b, float alpha, float* c, std::ptrdiff_t ldc, int mr, int nr) {
+   __m512 c0 = _mm512_setzero_ps(), c1 = _mm512_setzero_ps(), c2 = _mm512_setzero_ps(), c3 = _mm512_setzero_ps();
+   for (int p = 0; p < kc; ++p) {
+      __m512 b_vec = _mm512_loadu_ps(b);
+      c0 = _mm512_fmadd_ps(_mm512_set1_ps(a[0]), b_vec, c0);
+      c1 = _mm512_fmadd_ps(_mm512_set1_ps(a[1]), b_vec, c1);
+      c2 = _mm512_fmadd_ps(_mm512_set1_ps(a[2]), b_vec, c2);
+      c3 = _mm512_fmadd_ps(_mm512_set1_ps(a[3]), b_vec, c3);
+      a += 4;
+      b += 16;
+   }
+   float tile[64];
+   _mm512_storeu_ps(tile, c0); _mm512_storeu_ps(tile + 16, c1); _mm512_storeu_ps(tile + 32, c2); _mm512_storeu_ps(tile + 48, c3);
+   accumulateTile<float, 4, 16>(tile, alpha, c, ldc, mr, nr);
+}
+
+// --- Transpose tiles (4 x 4 for 8 byte types, 8 x 8 for 4 byte types) ---
+
+LINEAR_ALGEBRA_TARGET("sse2")
+inline void transposeTileSse2(const double* src, std::ptrdiff_t lds, double* dst, std::ptrdiff_t ldd) {
+   for (int i = 0; i < 4; i += 2) {
+      for (int j = 0; j < 4; j += 2) {
+         __m128d r0 = _mm_loadu_pd(src + i * lds + j), r1 = _mm_loadu_pd(src + (i + 1) * lds + j);
+         _mm_storeu_pd(dst + j * ldd + i, _mm_unpacklo_pd(r0, r1));
+         _mm_storeu_pd(dst + (j + 1) * ldd + i, _mm_unpackhi_pd(r0, r1));
+      }
+   }
+}
+
+LINEAR_ALGEBRA_TARGET("sse2")
+inline void transposeTileSse2(const float* src, std::ptrdiff_t lds, float* dst, std::ptrdiff_t ldd) {
+   for (int i = 0; i < 8; i += 4) {
+      for (int j = 0; j < 8; j += 4) {
+         __m128 r0 = _mm_loadu_ps(src + i * lds + j), r1 = _mm_loadu_ps(src + (i + 1) * lds + j);
+         __m128 r2 = _mm_loadu_ps(src + (i + 2) * lds + j), r3 = _mm_loadu_ps(src + (i + 3) * lds + j);
+         _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+         _mm_storeu_ps(dst + j * ldd + i, r0);
+         _mm_storeu_ps(dst + (j + 1) * ldd + i, r1);
+         _mm_storeu_ps(dst + (j + 2) * ldd + i, r2);
+         _mm_storeu_ps(dst + (j + 3) * ldd + i, r3);
+      }
+   }
+}
+
+LINEAR_ALGEBRA_TARGET("avx2")
+inline void transposeTileAvx2(const double* src, std::ptrdiff_t lds, double* dst, std::ptrdiff_t ldd) {
+   __m256d r0 = _mm256_loadu_pd(src), r1 = _mm256_loadu_pd(src + lds);
+   __m256d r2 = _mm256_loadu_pd(src + 2 * lds), r3 = _mm256_loadu_pd(src + 3 * lds);
+   __m256d t0 = _mm256_unpacklo_pd(r0, r1), t1 = _mm256_unpackhi_pd(r0, r1);
+   __m256d t2 = _mm256_unpacklo_pd(r2, r3), t3 = _mm256_unpackhi_pd(r2, r3);
+   _mm256_storeu_pd(dst, _mm256_permute2f128_pd(t0, t2, 0x20));
+   _mm256_storeu_pd(dst + ldd, _mm256_permute2f128_pd(t1, t3, 0x20));
+   _mm256_storeu_pd(dst + 2 * ldd, _mm256_permute2f128_pd(t0, t2, 0x31));
+   _mm256_storeu_pd(dst + 3 * ldd, _mm256_permute2f128_pd(t1, t3, 0x31));
+}
+
+LINEAR_ALGEBRA_TARGET("avx2")
+inline void transposeTileAvx2(const float* src, std::ptrdiff_t lds, float* dst, std::ptrdiff_t ldd) {
+   __m256 r[8], t[8];
+   for (int i = 0; i < 8; ++i) r[i] = _mm256_loadu_ps(src + i * lds);
+   for (int i = 0; i < 8; i += 2) {
+      t[i] = _mm256_unpacklo_ps(r[i], r[i + 1]);
+      t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+   }
+   for (int i = 0; i < 8; i += 4) {
+      r[i] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+      r[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+      r[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+      r[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+   }
+   for (int i = 0; i < 4; ++i) {
+      _mm256_storeu_ps(dst + i * ldd, _mm256_permute2f128_ps(r[i], r[i + 4], 0x20));
+      _mm256_storeu_ps(dst + (i + 4) * ldd, _mm256_permute2f128_ps(r[i], r[i + 4], 0x31));
+   }
+}
+
+// int tiles are moved as raw 32 bit lanes through the float shuffles.
+inline void transposeTileSse2(const int* src, std::ptrdiff_t lds, int* dst, std::ptrdiff_t ldd) {
+   transposeTileSse2(reinterpret_cast<const float*>(src), lds, reinterpret_cast<float*>(dst), ldd);
+}
+
+inline void transposeTileAvx2(const int* src, std::ptrdiff_t lds, int* dst, std::ptrdiff_t ldd) {
+   transposeTileAvx2(reinterpret_cast<const float*>(src), lds, reinterpret_cast<float*>(dst), ldd);
+}
+
+// --- Elementwise kernels ---
+
+/**
+ * Defines the five elementwise kernels for one (instruction set, Scalar) pair. Each kernel runs whole vectors and
+ * finishes the tail with the portable loop.
+*/
+#define LINEAR_ALGEBRA_ELEMENTWISE_KERNELS(Suffix, isa, Scalar, Vec, width, load, store, set1, add, sub, mul) \
+   LINEAR_ALGEBRA_TARGET(isa) inline void addKernel##Suffix(std::size_t n, const Scalar* x, const Scalar* y, Scalar* out) { \
+      std::size_t i = 0; \
+      for (; i + width <= n; i += width) store(out + i, add(load(x + i), load(y + i))); \
+      addKernel(n - i, x + i, y + i, out + i); \
+   } \
+   LINEAR_ALGEBRA_TARGET(isa) inline void subtractKernel##Suffix(std::size_t n, const Scalar* x, const Scalar* y, Scalar* out) { \
+      std::size_t i = 0; \
+      for (; i + width <= n; i += width) store(out + i, sub(load(x + i), load(y + i))); \
+      subtractKernel(n - i, x + i, y + i, out + i); \
+   } \
+   LINEAR_ALGEBRA_TARGET(isa) inline void multiplyKernel##Suffix(std::size_t n, const Scalar* x, const Scalar* y, Scalar* out) { \
+      std::size_t i = 0; \
+      for (; i + width <= n; i += width) store(out + i, mul(load(x + i), load(y + i))); \
+      multiplyKernel(n - i, x + i, y + i, out + i); \
+   } \
+   LINEAR_ALGEBRA_TARGET(isa) inline void scaleKernel##Suffix(std::size_t n, Scalar alpha, const Scalar* x, Scalar* out) { \
+      std::size_t i = 0; \
+      Vec alpha_vec = set1(alpha); \
+      for (; i + width <= n; i += width) store(out + i, mul(alpha_vec, load(x + i))); \
+      scaleKernel(n - i, alpha, x + i, out + i); \
+   } \
+   LINEAR_ALGEBRA_TARGET(isa) inline void axpyKernel##Suffix(std::size_t n, Scalar alpha, const Scalar* x, Scalar* y) { \
+      std::size_t i = 0; \
+      Vec alpha_vec = set1(alpha); \
+      for (; i + width <= n; i += width) store(y + i, add(load(y + i), mul(alpha_vec, load(x + i)))); \
+      axpyKernel(n - i, alpha, x + i, y + i); \
+   }
+
+#define LINEAR_ALGEBRA_LOAD_SI256(p) _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))
+#define LINEAR_ALGEBRA_STORE_SI256(p, v) _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v)
+
+LINEAR_ALGEBRA_ELEMENTWISE_KERNELS(Sse2, "sse2", double, __m128d, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd, _mm_add_pd, _mm_sub_pd, _mm_mul_pd)
+LINEAR_ALGEBRA_ELEMENTWISE_KERNELS(Sse2, "sse2", float, __m128, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps, _mm_add_ps, _mm_sub_ps, _mm_mul_ps)
+LINEAR_ALGEBRA_ELEMENTWISE_KERNELS(Avx2, "avx2", double, __m256d, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd, _mm256_add_pd, _mm256_sub_pd, _mm256_mul_pd)
+LINEAR_ALGEBRA_ELEMENTWISE_KERNELS(Avx2, "avx2", float, __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_set1_ps, _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps)
+LINEAR_ALGEBRA_ELEMENTWISE_KERNELS(Avx2, "avx2", int, __m256i, 8, LINEAR_ALGEBRA_LOAD_SI256, LINEAR_ALGEBRA_STORE_SI256, _mm256_set1_epi32, _mm256_add_epi32, _mm256_sub_epi32, _mm256_mullo_epi32)
+LINEAR_ALGEBRA_ELEMENTWISE_KERNELS(Avx512, "avx512f", double, __m512d, 8, _mm512_loadu_pd, _mm512_storeu_pd, _mm512_set1_pd, _mm512_add_pd, _mm512_sub_pd, _mm512_mul_pd)
+LINEAR_ALGEBRA_ELEMENTWISE_KERNELS(Avx512, "avx512f", float, __m512, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_set1_ps, _mm512_add_ps, _mm512_sub_ps, _mm512_mul_ps)
+LINEAR_ALGEBRA_ELEMENTWISE_KERNELS(Avx512, "avx512f", int, __m512i, 16, _mm512_loadu_si512, _mm512_storeu_si512, _mm512_set1_epi32, _mm512_add_epi32, _mm512_sub_epi32, _mm512_mullo_epi32)
+
+#undef LINEAR_ALGEBRA_ELEMENTWISE_KERNELS
+#undef LINEAR_ALGEBRA_LOAD_SI256
+#undef LINEAR_ALGEBRA_STORE_SI256
+
+// --- Batched multiplication kernels, one VecBytes wide vector per register over the interleaved batch ---
+
+/**
+ * batchKernel() written with GCC/Clang vector extensions, so each wrapper below compiles it for its own instruction
+ * set: a group of BatchWidth matrices is 64 / VecBytes vectors wide and the accumulators stay in registers.
+*/
+template<typename Scalar, int VecBytes>
+__attribute__((always_inline))
+inline void batchKernelVector(int m, int n, int k, const Scalar* a, const Scalar* b, Scalar* c) {
+   typedef Scalar Lanes __attribute__((vector_size(VecBytes)));
+   const int W = BatchWidth<Scalar>::value, L = VecBytes / sizeof(Scalar), V = W / L;
+   for (int i = 0; i < m; ++i) {
+      const Scalar* a_row = a + static_cast<std::ptrdiff_t>(i) * k * W;
+      int j = 0;
+      for (; j + 4 <= n; j += 4) {
+         Lanes acc[4][V];
+         for (int jj = 0; jj < 4; ++jj) for (int v = 0; v < V; ++v) acc[jj][v] = Lanes{};
+         for (int p = 0; p < k; ++p) {
+            const Scalar* b_lanes = b + (static_cast<std::ptrdiff_t>(p) * n + j) * W;
+            for (int v = 0; v < V; ++v) {
+               Lanes a_vec;
+               std::memcpy(&a_vec, a_row + p * W + v * L, sizeof(Lanes));
+               for (int jj = 0; jj < 4; ++jj) {
+                  Lanes b_vec;
+                  std::memcpy(&b_vec, b_lanes + jj * W + v * L, sizeof(Lanes));
+                  acc[jj][v] += a_vec * b_vec;
+               }
+            }
+         }
+         Scalar* c_lanes = c + (static_cast<std::ptrdiff_t>(i) * n + j) * W;
+         for (int jj = 0; jj < 4; ++jj) for (int v = 0; v < V; ++v) std::memcpy(c_lanes + jj * W + v * L, &acc[jj][v], sizeof(Lanes));
+      }
+      for (; j < n; ++j) {
+         Lanes acc[V];
+         for (int v = 0; v < V; ++v) acc[v] = Lanes{};
+         for (int p = 0; p < k; ++p) {
+            const Scalar* b_lanes = b + (static_cast<std::ptrdiff_t>(p) * n + j) * W;
+            for (int v = 0; v < V; ++v) {
+               Lanes a_vec, b_vec;
+               std::memcpy(&a_vec, a_row + p * W + v * L, sizeof(Lanes));
+               std::memcpy(&b_vec, b_lanes + v * L, sizeof(Lanes));
+               acc[v] += a_vec * b_vec;
+            }
+         }
+         Scalar* c_lanes = c + (static_cast<std::ptrdiff_t>(i) * n + j) * W;
+         for (int v = 0; v < V; ++v) std::memcpy(c_lanes + v * L, &acc[v], sizeof(Lanes));
+      }
+   }
+}
+
+#define LINEAR_ALGEBRA_BATCH_KERNEL(name, isa, type, bytes) \
+   LINEAR_ALGEBRA_TARGET(isa) \
+   inline void name(int m, int n, int k, const type* a, const type* b, type* c) { \
+      batchKernelVector<type, bytes>(m, n, k, a, b, c); \
+   }
+
+LINEAR_ALGEBRA_BATCH_KERNEL(batchKernelSse2, "sse2", double, 16)
+LINEAR_ALGEBRA_BATCH_KERNEL(batchKernelSse2, "sse2", float, 16)
+LINEAR_ALGEBRA_BATCH_KERNEL(batchKernelAvx2, "avx2,fma", double, 32)
+LINEAR_ALGEBRA_BATCH_KERNEL(batchKernelAvx2, "avx2,fma", float, 32)
+LINEAR_ALGEBRA_BATCH_KERNEL(batchKernelAvx2, "avx2,fma", int, 32)
+LINEAR_ALGEBRA_BATCH_KERNEL(batchKernelAvx512, "avx512f", double, 64)
+LINEAR_ALGEBRA_BATCH_KERNEL(batchKernelAvx512, "avx512f", float, 64)
+LINEAR_ALGEBRA_BATCH_KERNEL(batchKernelAvx512, "avx512f", int, 64)
+
+#undef LINEAR_ALGEBRA_BATCH_KERNEL
+
+// Each level starts from the kernels of the level below it and replaces the ones it has its own version of.
+template<>
+inline KernelTable<double> buildKernelTable<double>(SimdLevel level) {
+   KernelTable<double> table = portableKernels<double>();
+   if (level >= SimdLevel::SSE2) {
+      table.micro_kernel = &microKernelSse2;
+      table.transpose_tile = &transposeTileSse2;
+      table.add = &addKernelSse2; table.subtract = &subtractKernelSse2; table.multiply = &multiplyKernelSse2;
+      table.scale = &scaleKernelSse2; table.axpy = &axpyKernelSse2;
+      table.batch_kernel = &batchKernelSse2;
+   }
+   if (level >= SimdLevel::AVX2) {
+      table.micro_kernel = &microKernelAvx2;
+      table.transpose_tile = &transposeTileAvx2;
+      table.add = &addKernelAvx2; table.subtract = &subtractKernelAvx2; table.multiply = &multiplyKernelAvx2;
+      table.scale = &scaleKernelAvx2; table.axpy = &axpyKernelAvx2;
+      table.batch_kernel = &batchKernelAvx2;
+   }
+   if (level >= SimdLevel::AVX512) {
+      table.micro_kernel = &microKernelAvx512;
+      table.add = &addKernelAvx512; table.subtract = &subtractKernelAvx512; table.multiply = &multiplyKernelAvx512;
+      table.scale = &scaleKernelAvx512; table.axpy = &axpyKernelAvx512;
+      table.batch_kernel = &batchKernelAvx512;
+   }
+   return table;
+}
+
+template<>
+inline KernelTable<float> buildKernelTable<float>(SimdLevel level) {
+   KernelTable<float> table = portableKernels<float>();
+   if (level >= SimdLevel::SSE2) {
+      table.micro_kernel = &microKernelSse2;
+      table.transpose_tile = &transposeTileSse2;
+      table.add = &addKernelSse2; table.subtract = &subtractKernelSse2; table.multiply = &multiplyKernelSse2;
+      table.scale = &scaleKernelSse2; table.axpy = &axpyKernelSse2;
+      table.batch_kernel = &batchKernelSse2;
+   }
+   if (level >= SimdLevel::AVX2) {
+      table.micro_kernel = &microKernelAvx2;
+      table.transpose_tile = &transposeTileAvx2;
+      table.add = &addKernelAvx2; table.subtract = &subtractKernelAvx2; table.multiply = &multiplyKernelAvx2;
+      table.scale = &scaleKernelAvx2; table.axpy = &axpyKernelAvx2;
+      table.batch_kernel = &batchKernelAvx2;
+   }
+   if (level >= SimdLevel::AVX512) {
+      table.micro_kernel = &microKernelAvx512;
+      table.add = &addKernelAvx512; table.subtract = &subtractKernelAvx512; table.multiply = &multiplyKernelAvx512;
+      table.scale = &scaleKernelAvx512; table.axpy = &axpyKernelAvx512;
+      table.batch_kernel = &batchKernelAvx512;
+   }
+   return table;
+}
+
+// SSE2 has no 32 bit lane multiply, so int only gets the transpose at that level.
+template<>
+inline KernelTable<int> buildKernelTable<int>(SimdLevel level) {
+   KernelTable<int> table = portableKernels<int>();
+   if (level >= SimdLevel::SSE2) {
+      table.transpose_tile = &transposeTileSse2;
+   }
+   if (level >= SimdLevel::AVX2) {
+      table.micro_kernel = &microKernelAvx2;
+      table.transpose_tile = &transposeTileAvx2;
+      table.add = &addKernelAvx2; table.subtract = &subtractKernelAvx2; table.multiply = &multiplyKernelAvx2;
+      table.scale = &scaleKernelAvx2; table.axpy = &axpyKernelAvx2;
+      table.batch_kernel = &batchKernelAvx2;
+   }
+   if (level >= SimdLevel::AVX512) {
+      table.add = &addKernelAvx512; table.subtract = &subtractKernelAvx512; table.multiply = &multiplyKernelAvx512;
+      table.scale = &scaleKernelAvx512; table.axpy = &axpyKernelAvx512;
+      table.batch_kernel = &batchKernelAvx512;
+   }
+   return table;
+}
+
+#undef LINEAR_ALGEBRA_TARGET
+
+#endif // LINEAR_ALGEBRA_X86_SIMD
+
+// Highest instruction set the CPU we are running on supports, queried once through CPUID.
+inline SimdLevel detectSimdLevel() {
+#if LINEAR_ALGEBRA_X86_SIMD
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx512f")) {
+      return SimdLevel::AVX512;
+   }
+   if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      return SimdLevel::AVX2;
+   }
+   if (__builtin_cpu_supports("sse2")) {
+      return SimdLevel::SSE2;
+   }
+#endif
+   return SimdLevel::Scalar;
+}
+
+inline SimdLevel& activeSimdLevel() {
+   static SimdLevel level = detectSimdLevel();
+   return level;
+}
+
+/**
+ * Kernels for the currently active SimdLevel. The tables for all levels are built once on first use, after that a
+ * dispatch is a single indexed load.
+*/
+template<typename Scalar>
+const KernelTable<Scalar>& kernels() {
+   static const KernelTable<Scalar> tables[] = {
+      buildKernelTable<Scalar>(SimdLevel::Scalar), buildKernelTable<Scalar>(SimdLevel::SSE2),
+      buildKernelTable<Scalar>(SimdLevel::AVX2), buildKernelTable<Scalar>(SimdLevel::AVX512)
+   };
+   return tables[static_cast<int>(activeSimdLevel())];
+}
+
+/**
+ * Out-of-place transpose of the rows x cols row-major block src (row stride lds) into dst (row stride ldd), walking
+ * both in square tiles so reads and writes each stay within a few cache lines. Full tiles go through the dispatched
+ * tile kernel, the ragged right and bottom edges through a plain loop.
+*/
+template<typename Scalar>
+void transposeBlock(int rows, int cols, const Scalar* src, std::ptrdiff_t lds, Scalar* dst, std::ptrdiff_t ldd) {
+   const int T = TransposeTile<Scalar>::size;
+   void (*tile_kernel)(const Scalar*, std::ptrdiff_t, Scalar*, std::ptrdiff_t) = kernels<Scalar>().transpose_tile;
+   int full_rows = rows - rows % T, full_cols = cols - cols % T;
+   for (int i = 0; i < full_rows; i += T) {
+      for (int j = 0; j < full_cols; j += T) {
+         tile_kernel(src + i * lds + j, lds, dst + j * ldd + i, ldd);
+      }
+   }
+   for (int i = 0; i < rows; ++i) {
+      for (int j = (i < full_rows ? full_cols : 0); j < cols; ++j) {
+         dst[j * ldd + i] = src[i * lds + j];
+      }
+   }
+}
+
+/**
+ * Cache-oblivious out-of-place transpose: halves the longer side of the block until it is at most 64 x 64 and
+ * hands the leaves to transposeBlock(), so every level of the cache hierarchy sees blocks that fit without the
+ * code having to know its sizes. Splits are kept at multiples of the tile size so leaves stay on the SIMD path.
+*/
+template<typename Scalar>
+void transposeRecursive(int rows, int cols, const Scalar* src, std::ptrdiff_t lds, Scalar* dst, std::ptrdiff_t ldd) {
+   const int T = TransposeTile<Scalar>::size;
+   const int leaf = 64;
+   if (rows <= leaf && cols <= leaf) {
+      transposeBlock(rows, cols, src, lds, dst, ldd);
+   } else if (rows >= cols) {
+      int half = std::max(T, rows / 2 / T * T);
+      transposeRecursive(half, cols, src, lds, dst, ldd);
+      transposeRecursive(rows - half, cols, src + half * lds, lds, dst + half, ldd);
+   } else {
+      int half = std::max(T, cols / 2 / T * T);
+      transposeRecursive(rows, half, src, lds, dst, ldd);
+      transposeRecursive(rows, cols - half, src + half, lds, dst + half * ldd, ldd);
+   }
+}
+
+/**
+ * In-place transpose of the tile rows starting at block_row in an n x n matrix: every tile (block_row, j) with
+ * j >= block_row is exchanged with its mirror tile (j, block_row). Both tiles are transposed into small stack
+ * buffers through the tile kernel and written back crosswise.
+*/
+template<typename Scalar>
+void transposeSquareBlockRow(int n, Scalar* a, std::ptrdiff_t lda, int block_row) {
+   const int T = TransposeTile<Scalar>::size;
+   void (*tile_kernel)(const Scalar*, std::ptrdiff_t, Scalar*, std::ptrdiff_t) = kernels<Scalar>().transpose_tile;
+   Scalar upper[T * T], lower[T * T];
+   int full = n - n % T;
+   for (int j = block_row; j < full; j += T) {
+      Scalar* upper_block = a + block_row * lda + j;
+      Scalar* lower_block = a + j * lda + block_row;
+      tile_kernel(upper_block, lda, upper, T);
+      if (j != block_row) {
+         tile_kernel(lower_block, lda, lower, T);
+         for (int r = 0; r < T; ++r) {
+            std::copy(lower + r * T, lower + (r + 1) * T, upper_block + r * lda);
+         }
+      }
+      for (int r = 0; r < T; ++r) {
+         std::copy(upper + r * T, upper + (r + 1) * T, lower_block + r * lda);
+      }
+   }
+}
+
+// Swaps the elements of an n x n matrix that lie outside the whole tiles handled by transposeSquareBlockRow().
+template<typename Scalar>
+void transposeSquareEdges(int n, Scalar* a, std::ptrdiff_t lda) {
+   int full = n - n % TransposeTile<Scalar>::size;
+   for (int i = 0; i < n; ++i) {
+      for (int j = std::max(i + 1, full); j < n; ++j) {
+         std::swap(a[i * lda + j], a[j * lda + i]);
+      }
+   }
+}
+
+/**
+ * In-place transpose of a rows x cols row-major matrix by following the cycles of the permutation
+ * k -> k * rows mod (rows * cols - 1), which sends the element at flat index k = i * cols + j to j * rows + i.
+ * Needs one bit per element to remember which positions are already in place, but never a second data buffer.
+*/
+template<typename Scalar>
+void transposeCycles(int rows, int cols, Scalar* a) {
+   if (rows <= 1 || cols <= 1) {
+      return; // A single row or column has the same flat layout as its transpose.
+   }
+   const std::size_t size = static_cast<std::size_t>(rows) * cols;
+   const std::size_t last = size - 1;
+   std::vector<bool> placed(size, false);
+   for (std::size_t start = 1; start < last; ++start) {
+      if (placed[start]) {
+         continue;
+      }
+      Scalar carry = a[start];
+      std::size_t position = start;
+      do {
+         position = position * rows % last;
+         std::swap(carry, a[position]);
+         placed[position] = true;
+      } while (position != start);
+   }
+}
+
+template<typename Scalar, typename LeftScalar, typename RightScalar>
+void gemmPacked(int m, int n, int k, Scalar alpha,
+                const LeftScalar* a, std::ptrdiff_t rs_a, std::ptrdiff_t cs_a,
+                const RightScalar* b, std::ptrdiff_t rs_b, std::ptrdiff_t cs_b,
+                Scalar* c, std::ptrdiff_t ldc) {
+   typedef GemmBlocking<Scalar> Blocking;
+   const int MR = Blocking::MR, NR = Blocking::NR, MC = Blocking::MC, KC = Blocking::KC, NC = Blocking::NC;
+
+   Scalar* packed_a = scratchBuffer<Scalar, 0>(static_cast<std::size_t>(MC) * KC);
+   Scalar* packed_b = scratchBuffer<Scalar, 1>(static_cast<std::size_t>(KC) * (NC + NR));
+   void (*micro_kernel)(int, const Scalar*, const Scalar*, Scalar, Scalar*, std::ptrdiff_t, int, int) =
+      kernels<Scalar>().micro_kernel;
+
+   for (int jc = 0; jc < n; jc += NC) {
+      int nc = std::min(NC, n - jc);
+      for (int pc = 0; pc < k; pc += KC) {
+         int kc = std::min(KC, k - pc);
+         packB<Scalar, NR>(kc, nc, b + pc * rs_b + jc * cs_b, rs_b, cs_b, packed_b);
+         for (int ic = 0; ic < m; ic += MC) {
+            int mc = std::min(MC, m - ic);
+            packA<Scalar, MR>(mc, kc, a + ic * rs_a + pc * cs_a, rs_a, cs_a, packed_a);
+            for (int jr = 0; jr < nc; jr += NR) {
+               int nr = std::min(NR, nc - jr);
+               for (int ir = 0; ir < mc; ir += MR) {
+                  int mr = std::min(MR, mc - ir);
+                  micro_kernel(kc, packed_a + ir * kc, packed_b + jr * kc, alpha,
+                               c + (ic + ir) * ldc + jc + jr, ldc, mr, nr);
+               }
+            }
+         }
+      }
+   }
+}
+
+/**
+ * General matrix multiply: C = alpha * A * B + beta * C.
+ *
+ * A is m x k and B is k x n, each addressed through a row stride and a column stride (so a transposed operand is just
+ * a swap of its strides), and C is an m x n row-major block with leading dimension ldc. Arithmetic types go through the
+ * packed, cache-blocked kernel, everything else through the plain loop. A and B may hold narrower element types than
+ * C (see ProductScalar); they are converted while packing and the product is accumulated in Scalar.
+*/
+template<typename Scalar, typename LeftScalar, typename RightScalar>
+void gemm(int m, int n, int k, Scalar alpha,
+          const LeftScalar* a, std::ptrdiff_t rs_a, std::ptrdiff_t cs_a,
+          const RightScalar* b, std::ptrdiff_t rs_b, std::ptrdiff_t cs_b,
+          Scalar beta, Scalar* c, std::ptrdiff_t ldc) {
+   if (m <= 0 || n <= 0) {
+      return;
+   }
+   scaleBlock(m, n, beta, c, ldc);
+   if (k <= 0 || alpha == Scalar(0)) {
+      return;
+   }
+   if (GemmBlocking<Scalar>::packed) {
+      gemmPacked(m, n, k, alpha, a, rs_a, cs_a, b, rs_b, cs_b, c, ldc);
+   } else {
+      gemmReference(m, n, k, alpha, a, rs_a, cs_a, b, rs_b, cs_b, c, ldc);
+   }
+}
+
+}  // End of namespace detail
+
+/**
+ * Widest instruction set supported by the CPU this process is running on.
+ * @returns: The SimdLevel detected through CPUID at startup.
+*/
+inline SimdLevel detectedSimdLevel() {
+   static const SimdLevel level = detail::detectSimdLevel();
+   return level;
+}
+
+/**
+ * Instruction set the multiply, transpose and elementwise kernels currently dispatch to.
+ * @returns: The active SimdLevel, which defaults to detectedSimdLevel().
+*/
+inline SimdLevel simdLevel() { return detail::activeSimdLevel(); }
+
+/**
+ * Restricts the kernels to a narrower instruction set, e.g. to compare results or timings between code paths.
+ * Requests above what the CPU supports are clamped to detectedSimdLevel(). Not meant to be changed while other
+ * threads are running kernels.
+ * @param level: The SimdLevel to dispatch to from now on.
+*/
+inline void setSimdLevel(SimdLevel level) {
+   detail::activeSimdLevel() = std::min(level, detectedSimdLevel());
+}
+
+/**
+ * Operations counted by the instrumentation layer (LINEAR_ALGEBRA_INSTRUMENTATION). Nested operations are counted at
+ * every level, e.g. the tile products of streamingMultiply() also show up under Multiply and a Matrix built from an
+ * expression also counts an Allocate.
+*/
+enum class Operation {
+   Multiply,           // Dense GEMM: operator*, gemm() and products inside expressions.
+   BatchMultiply,      // batchMultiply().
+   StreamingMultiply,  // streamingMultiply().
+   SparseMultiply,     // SparseMatrix products with vectors and dense matrices.
+   Transpose,          // In-place transpose().
+   TransposeInto,      // transposeInto() and evaluation of transposed views.
+   Elementwise,        // Evaluation of elementwise expressions: +, -, scaling, hadamard(), +=, -=.
+   Allocate,           // Matrix buffers handed out by the storage pool or a ScratchArena.
+   Copy,               // Matrix copy construction, copy assignment and reserve().
+   FileIO              // save() and load().
+};
+
+/**
+ * Name of an operation as it appears in writeInstrumentationJson(), e.g. "multiply" or "transpose_into".
+ * @param operation: The operation.
+ * @returns: A lower case name.
+*/
+inline const char* operationName(Operation operation) {
+   static const char* const names[] = {"multiply", "batch_multiply", "streaming_multiply", "sparse_multiply",
+                                       "transpose", "transpose_into", "elementwise", "allocate", "copy", "file_io"};
+   return names[static_cast<int>(operation)];
+}
+
+/**
+ * Counters of one operation within one shape bucket, see instrumentationSnapshot().
+*/
+struct OperationStats {
+   Operation operation;
+   std::size_t bucket;          // Largest dimension rounded up to a power of two (element count for Allocate and Copy).
+   std::uint64_t calls;
+   std::uint64_t flops;
+   std::uint64_t bytes;         // Bytes allocated or copied; operand plus result bytes for the other operations.
+   double seconds;              // Wall time summed over calls, so concurrent calls add up.
+   std::uint64_t cycles;        // Hardware counters, 0 unless enableHardwareCounters() succeeded.
+   std::uint64_t instructions;
+   std::uint64_t cache_misses;
+};
+
+namespace detail {
+
+const int kOperationCount = static_cast<int>(Operation::FileIO) + 1;
+const int kShapeBuckets = 48;
+
+enum InstrumentationCounter { kCalls, kFlops, kBytes, kNanoseconds, kCycles, kInstructions, kCacheMisses, kCounterCount };
+
+// Counters of every operation and shape bucket. Static storage starts zeroed, so no constructor has to run first.
+struct InstrumentationTable {
+   std::atomic<std::uint64_t> counters[kOperationCount][kShapeBuckets][kCounterCount];
+};
+
+inline InstrumentationTable& instrumentationTable() {
+   static InstrumentationTable table;
+   return table;
+}
+
+// Index of the smallest power of two that is at least "size".
+inline int shapeBucket(std::size_t size) {
+   int bucket = 0;
+   while (bucket + 1 < kShapeBuckets && (std::size_t(1) << bucket) < size) {
+      ++bucket;
+   }
+   return bucket;
+}
+
+/**
+ * Process-wide perf_event counters for cycles, instructions and cache misses. The counters are inherited by threads
+ * created after they are opened, and reading one sums over those threads, so operations that run on the thread pool
+ * are covered as long as the pool starts afterwards.
+*/
+class HardwareCounters
+{
+   public:
+
+      static const int kEvents = 3;
+
+      static HardwareCounters& global() {
+         static HardwareCounters counters;
+         return counters;
+      }
+
+      bool open() {
+         std::lock_guard<std::mutex> lock(mutex);
+         if (enabled.load(std::memory_order_relaxed)) {
+            return true;
+         }
+#if LINEAR_ALGEBRA_HAS_PERF_EVENT
+         const std::uint64_t configs[kEvents] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                 PERF_COUNT_HW_CACHE_MISSES};
+         for (int i = 0; i < kEvents; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = configs[i];
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fds[i] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+            if (fds[i] < 0) {
+               closeAll();
+               return false;
+            }
+         }
+         enabled.store(true, std::memory_order_release);
+         return true;
+#else
+         return false;
+#endif
+      }
+
+      bool isOpen() const { return enabled.load(std::memory_order_acquire); }
+
+      // Current totals, or zeros if the counters are not open.
+      void read(std::uint64_t (&values)[kEvents]) const {
+         for (int i = 0; i < kEvents; ++i) {
+            values[i] = 0;
+#if LINEAR_ALGEBRA_HAS_PERF_EVENT
+            if (isOpen() && ::read(fds[i], &values[i], sizeof(values[i])) != static_cast<ssize_t>(sizeof(values[i]))) {
+               values[i] = 0;
+            }
+#endif
+         }
+      }
+
+      ~HardwareCounters() { closeAll(); }
+
+   private:
+
+      int fds[kEvents];
+      std::atomic<bool> enabled;
+      std::mutex mutex;
+
+      HardwareCounters() : enabled(false) {
+         std::fill(fds, fds + kEvents, -1);
+      }
+
+      void closeAll() {
+         enabled.store(false, std::memory_order_release);
+         for (int i = 0; i < kEvents; ++i) {
+#if LINEAR_ALGEBRA_HAS_PERF_EVENT
+            if (fds[i] >= 0) {
+               ::close(fds[i]);
+            }
+#endif
+            fds[i] = -1;
+         }
+      }
+};
+
+inline void registerInstrumentationDump();
+
+/**
+ * Times one call of an operation and adds it to the counters when it goes out of scope. Created through the
+ * LINEAR_ALGEBRA_INSTRUMENT macro, which expands to nothing unless LINEAR_ALGEBRA_INSTRUMENTATION is set.
+*/
+class ScopedOperation
+{
+   public:
+
+      ScopedOperation(Operation operation, std::size_t size, double flops, double bytes)
+         : operation(operation), bucket(shapeBucket(size)), flops(flops), bytes(bytes),
+           hardware(HardwareCounters::global().isOpen()), start(std::chrono::steady_clock::now()) {
+         HardwareCounters::global().read(events);
+      }
+
+      ScopedOperation(const ScopedOperation&) = delete;
+      ScopedOperation& operator=(const ScopedOperation&) = delete;
+
+      ~ScopedOperation() {
+         std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+         std::uint64_t end[HardwareCounters::kEvents];
+         HardwareCounters::global().read(end);
+         std::atomic<std::uint64_t>* counters = instrumentationTable().counters[static_cast<int>(operation)][bucket];
+         counters[kCalls].fetch_add(1, std::memory_order_relaxed);
+         counters[kFlops].fetch_add(static_cast<std::uint64_t>(flops), std::memory_order_relaxed);
+         counters[kBytes].fetch_add(static_cast<std::uint64_t>(bytes), std::memory_order_relaxed);
+         counters[kNanoseconds].fetch_add(
+            static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()),
+            std::memory_order_relaxed);
+         if (hardware) {
+            for (int i = 0; i < HardwareCounters::kEvents; ++i) {
+               counters[kCycles + i].fetch_add(end[i] >= events[i] ? end[i] - events[i] : 0, std::memory_order_relaxed);
+            }
+         }
+         registerInstrumentationDump();
+      }
+
+   private:
+
+      Operation operation;
+      int bucket;
+      double flops;
+      double bytes;
+      bool hardware;
+      std::chrono::steady_clock::time_point start;
+      std::uint64_t events[HardwareCounters::kEvents];
+};
+
+}  // End of namespace detail
+
+#if LINEAR_ALGEBRA_INSTRUMENTATION
+#define LINEAR_ALGEBRA_INSTRUMENT(operation, size, flops, bytes) \
+   ::LinearAlgebra::detail::ScopedOperation linear_algebra_scoped_operation( \
+      ::LinearAlgebra::Operation::operation, (size), (flops), (bytes))
+#else
+#define LINEAR_ALGEBRA_INSTRUMENT(operation, size, flops, bytes) ((void)0)
+#endif
+
+/**
+ * GETTER
+ * @returns: Whether the library was compiled with LINEAR_ALGEBRA_INSTRUMENTATION, i.e. whether anything is counted.
+*/
+inline bool instrumentationEnabled() { return LINEAR_ALGEBRA_INSTRUMENTATION != 0; }
+
+/**
+ * Opens the Linux perf_event counters for cycles, instructions and cache misses, which are then added to every
+ * counted operation. Call it before the first parallel operation or setNumThreads(), since only threads started
+ * afterwards are covered. Operations running concurrently from several threads see each other's events.
+ * @returns: False if the library is not instrumented, the platform is not Linux or the kernel refuses the counters
+ *    (e.g. because of /proc/sys/kernel/perf_event_paranoid).
+*/
+inline bool enableHardwareCounters() {
+   return instrumentationEnabled() && detail::HardwareCounters::global().open();
+}
+
+/**
+ * Reads the instrumentation counters. The counters are updated without locking, so a snapshot taken while other
+ * threads run operations may be off by the operations in flight.
+ * @returns: One entry per operation and shape bucket that was called at least once, ordered by operation and bucket.
+*/
+inline std::vector<OperationStats> instrumentationSnapshot() {
+   std::vector<OperationStats> snapshot;
+   detail::InstrumentationTable& table = detail::instrumentationTable();
+   for (int op = 0; op < detail::kOperationCount; ++op) {
+      for (int bucket = 0; bucket < detail::kShapeBuckets; ++bucket) {
+         const std::atomic<std::uint64_t>* counters = table.counters[op][bucket];
+         std::uint64_t calls = counters[detail::kCalls].load(std::memory_order_relaxed);
+         if (calls == 0) {
+            continue;
+         }
+         OperationStats stats;
+         stats.operation = static_cast<Operation>(op);
+         stats.bucket = std::size_t(1) << bucket;
+         stats.calls = calls;
+         stats.flops = counters[detail::kFlops].load(std::memory_order_relaxed);
+         stats.bytes = counters[detail::kBytes].load(std::memory_order_relaxed);
+         stats.seconds = counters[detail::kNanoseconds].load(std::memory_order_relaxed) * 1e-9;
+         stats.cycles = counters[detail::kCycles].load(std::memory_order_relaxed);
+         stats.instructions = counters[detail::kInstructions].load(std::memory_order_relaxed);
+         stats.cache_misses = counters[detail::kCacheMisses].load(std::memory_order_relaxed);
+         snapshot.push_back(stats);
+      }
+   }
+   return snapshot;
+}
+
+/**
+ * Sets all instrumentation counters back to zero, e.g. at the start of a request.
+*/
+inline void resetInstrumentation() {
+   detail::InstrumentationTable& table = detail::instrumentationTable();
+   for (int op = 0; op < detail::kOperationCount; ++op) {
+      for (int bucket = 0; bucket < detail::kShapeBuckets; ++bucket) {
+         for (int counter = 0; counter < detail::kCounterCount; ++counter) {
+            table.counters[op][bucket][counter].store(0, std::memory_order_relaxed);
+         }
+      }
+   }
+}
+
+/**
+ * Writes instrumentationSnapshot() as JSON, one object per operation and shape bucket with the raw counters plus
+ * GFLOP/s and, when hardware counters are enabled, instructions per cycle.
+ * @param os: Stream to write to.
+*/
+inline void writeInstrumentationJson(std::ostream& os) {
+   std::vector<OperationStats> snapshot = instrumentationSnapshot();
+   os << "{\n  \"instrumentation\": " << (instrumentationEnabled() ? "true" : "false")
+      << ", \"hardware_counters\": " << (detail::HardwareCounters::global().isOpen() ? "true" : "false")
+      << ",\n  \"operations\": [\n";
+   for (std::size_t i = 0; i < snapshot.size(); ++i) {
+      const OperationStats& stats = snapshot[i];
+      os << "    {\"operation\": \"" << operationName(stats.operation) << "\", \"bucket\": " << stats.bucket
+         << ", \"calls\": " << stats.calls << ", \"flops\": " << stats.flops << ", \"bytes\": " << stats.bytes
+         << ", \"seconds\": " << stats.seconds
+         << ", \"gflops\": " << (stats.seconds > 0 ? stats.flops / stats.seconds * 1e-9 : 0.0)
+         << ", \"cycles\": " << stats.cycles << ", \"instructions\": " << stats.instructions
+         << ", \"cache_misses\": " << stats.cache_misses
+         << ", \"ipc\": " << (stats.cycles > 0 ? static_cast<double>(stats.instructions) / stats.cycles : 0.0) << "}"
+         << (i + 1 < snapshot.size() ? ",\n" : "\n");
+   }
+   os << "  ]\n}\n";
+}
+
+namespace detail {
+
+// Destination of the dump at exit, from dumpInstrumentationAtExit() or the LINEAR_ALGEBRA_STATS environment variable.
+inline std::string& instrumentationDumpPath() {
+   static std::string path;
+   return path;
+}
+
+inline void dumpInstrumentation() {
+   const std::string& path = instrumentationDumpPath();
+   if (path.empty()) {
+      return;
+   }
+   if (path == "-") {
+      writeInstrumentationJson(std::cerr);
+      return;
+   }
+   std::ofstream file(path.c_str(), std::ios::trunc);
+   writeInstrumentationJson(file);
+}
+
+// Registers dumpInstrumentation() with atexit the first time an operation is counted.
+inline void registerInstrumentationDump() {
+   static const bool registered = [] {
+      // The path is constructed before the handler is registered, so it is destroyed only after the handler ran.
+      std::string& path = instrumentationDumpPath();
+      const char* variable = std::getenv("LINEAR_ALGEBRA_STATS");
+      if (path.empty() && variable != nullptr) {
+         path = variable;
+      }
+      return std::atexit(dumpInstrumentation) == 0;
+   }();
+   (void)registered;
+}
+
+}  // End of namespace detail
+
+/**
+ * Writes writeInstrumentationJson() to "path" when the program exits, "-" writes to stderr. Setting the environment
+ * variable LINEAR_ALGEBRA_STATS does the same without code changes. Call it before running operations from other
+ * threads.
+ * @param path: File to write at exit.
+*/
+inline void dumpInstrumentationAtExit(const std::string& path) {
+   detail::registerInstrumentationDump();
+   detail::instrumentationDumpPath() = path;
+}
+
+/**
+ * Work-stealing thread pool shared by the parallel kernels.
+ *
+ * The workers are created once and sleep while there is nothing to do, so a parallel multiply never pays for thread
+ * creation. parallelFor() spreads its task indices round-robin over per-worker deques; a worker pops from the back of
+ * its own deque and steals from the front of the others once it runs dry, which keeps all workers busy when tiles take
+ * uneven time. The calling thread steals as well, so a pool of size N runs on N - 1 workers plus the caller.
+ * A parallelFor() issued from inside a task runs serially on that thread instead of nesting.
+*/
+class ThreadPool
+{
+   private:
+
+      struct Job {
+         const std::function<void(int)>* task;
+         std::atomic<int> remaining;
+         std::mutex mutex;
+         std::condition_variable finished;
+         std::exception_ptr error;
+      };
+
+      struct Task {
+         Job* job;
+         int index;
+      };
+
+      struct Worker {
+         std::mutex mutex;
+         std::deque<Task> tasks;
+      };
+
+      std::vector<std::unique_ptr<Worker>> workers; // One deque per worker thread.
+      std::vector<std::thread> threads;
+      std::atomic<int> queued; // Number of tasks sitting in any deque.
+      std::mutex sleep_mutex;
+      std::condition_variable wake_up;
+      bool stopping;
+
+      static bool& insideTask() {
+         thread_local bool inside = false;
+         return inside;
+      }
+
+      bool popOwn(int worker, Task& task) {
+         std::lock_guard<std::mutex> lock(workers[worker]->mutex);
+         if (workers[worker]->tasks.empty()) {
+            return false;
+         }
+         task = workers[worker]->tasks.back();
+         workers[worker]->tasks.pop_back();
+         queued--;
+         return true;
+      }
+
+      bool steal(int thief, Task& task) {
+         int count = static_cast<int>(workers.size());
+         for (int offset = 1; offset <= count; ++offset) {
+            int victim = (thief + offset) % count;
+            std::lock_guard<std::mutex> lock(workers[victim]->mutex);
+            if (!workers[victim]->tasks.empty()) {
+               task = workers[victim]->tasks.front();
+               workers[victim]->tasks.pop_front();
+               queued--;
+               return true;
+            }
+         }
+         return false;
+      }
+
+      static void run(const Task& task) {
+         Job& job = *task.job;
+         bool& inside = insideTask();
+         bool was_inside = inside;
+         inside = true;
+         try {
+            (*job.task)(task.index);
+         } catch (...) {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            if (!job.error) {
+               job.error = std::current_exception();
+            }
+         }
+         inside = was_inside;
+         // Decrement under the lock so the owner cannot see zero and destroy the job before we notify.
+         std::lock_guard<std::mutex> lock(job.mutex);
+         if (--job.remaining == 0) {
+            job.finished.notify_all();
+         }
+      }
+
+      void workerLoop(int worker) {
+         Task task;
+         while (true) {
+            if (popOwn(worker, task) || steal(worker, task)) {
+               run(task);
+               continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            wake_up.wait(lock, [this] { return stopping || queued > 0; });
+            if (stopping) {
+               return;
+            }
+         }
+      }
+
+      // Pins worker "worker" to its own CPU, leaving CPU 0 to the thread that owns the pool.
+      void pin(int worker) {
+#if defined(__linux__)
+         unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+         cpu_set_t set;
+         CPU_ZERO(&set);
+         CPU_SET((worker + 1) % cpus, &set);
+         pthread_setaffinity_np(threads[worker].native_handle(), sizeof(cpu_set_t), &set);
+#else
+         (void)worker;
+#endif
+      }
+
+   public:
+      /**
+       * Constructor: Starts the worker threads.
+       * @param num_threads: Total number of threads working on a parallelFor(), including the calling thread.
+       *    Values below 1 are treated as 1, i.e. everything runs on the caller.
+       * @param pin_threads: Pin every worker to its own CPU (Linux only, ignored elsewhere).
+      */
+      explicit ThreadPool(int num_threads, bool pin_threads = false) : queued(0), stopping(false) {
+         int worker_count = std::max(1, num_threads) - 1;
+         for (int i = 0; i < worker_count; ++i) {
+            workers.emplace_back(new Worker());
+         }
+         for (int i = 0; i < worker_count; ++i) {
+            threads.emplace_back(&ThreadPool::workerLoop, this, i);
+            if (pin_threads) {
+               pin(i);
+            }
+         }
+      }
+
+      ThreadPool(const ThreadPool&) = delete;
+      ThreadPool& operator=(const ThreadPool&) = delete;
+
+      // Destructor: Wakes and joins all workers. Must not run while a parallelFor() is in flight.
+      ~ThreadPool() {
+         {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+         }
+         wake_up.notify_all();
+         for (auto& thread : threads) {
+            thread.join();
+         }
+      }
+
+      /**
+       * GETTER
+       * @returns: Number of threads taking part in a parallelFor(), including the caller.
+      */
+      int size() const { return static_cast<int>(threads.size()) + 1; }
+
+      /**
+       * Runs task(i) for every i in [0, count) on the pool and blocks until all of them have finished.
+       * @param count: Number of task indices.
+       * @param task: Callable invoked once per index, possibly concurrently.
+       * @throws Rethrows the first exception thrown by any task, after all tasks have finished.
+      */
+      void parallelFor(int count, const std::function<void(int)>& task) {
+         if (count <= 0) {
+            return;
+         }
+         if (workers.empty() || count == 1 || insideTask()) {
+            for (int i = 0; i < count; ++i) {
+               task(i);
+            }
+            return;
+         }
+
+         Job job;
+         job.task = &task;
+         job.remaining = count;
+         int worker_count = static_cast<int>(workers.size());
+         for (int i = 0; i < count; ++i) {
+            Task queued_task = {&job, i};
+            std::lock_guard<std::mutex> lock(workers[i % worker_count]->mutex);
+            workers[i % worker_count]->tasks.push_back(queued_task);
+            queued++;
+         }
+         {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+         }
+         wake_up.notify_all();
+
+         // Help out until every task has been taken, then wait for the ones still running.
+         Task stolen;
+         while (job.remaining > 0 && steal(0, stolen)) {
+            run(stolen);
+         }
+         {
+            std::unique_lock<std::mutex> lock(job.mutex);
+            job.finished.wait(lock, [&job] { return job.remaining == 0; });
+         }
+         if (job.error) {
+            std::rethrow_exception(job.error);
+         }
+      }
+
+      /**
+       * The pool used by Matrix operations. Created on first use with one thread per hardware thread.
+       * @returns: The library wide thread pool.
+      */
+      static ThreadPool& global() {
+         return *globalHolder();
+      }
+
+      /**
+       * Replaces the library wide pool. Must not be called while a Matrix operation is running on another thread.
+       * @param num_threads: Total thread count of the new pool, 1 makes every operation serial.
+       * @param pin_threads: Pin the workers of the new pool to their own CPUs.
+      */
+      static void setGlobal(int num_threads, bool pin_threads = false) {
+         globalHolder().reset(new ThreadPool(num_threads, pin_threads));
+      }
+
+   private:
+      static std::unique_ptr<ThreadPool>& globalHolder() {
+         static std::unique_ptr<ThreadPool> pool(new ThreadPool(static_cast<int>(std::max(1u, std::thread::hardware_concurrency()))));
+         return pool;
+      }
+};
+
+/**
+ * Sets the number of threads Matrix operations run on.
+ * @param num_threads: Total thread count, 1 disables threading.
+ * @param pin_threads: Pin each worker thread to its own CPU (Linux only).
+*/
+inline void setNumThreads(int num_threads, bool pin_threads = false) {
+   ThreadPool::setGlobal(num_threads, pin_threads);
+}
+
+/**
+ * GETTER
+ * @returns: Number of threads Matrix operations run on.
+*/
+inline int numThreads() { return ThreadPool::global().size(); }
+
+namespace detail {
+
+inline std::size_t& parallelThresholdValue() {
+   static std::size_t threshold = std::size_t(128) * 128 * 128;
+   return threshold;
+}
+
+}  // End of namespace detail
+
+/**
+ * Sets the amount of work below which operations stay on the calling thread because handing tiles to the pool
+ * would cost more than it saves. Work is counted in multiply-adds for a product (rows * cols * inner dimension)
+ * and in moved elements for a transpose.
+ * @param work: The new threshold, 0 parallelizes everything.
+*/
+inline void setParallelThreshold(std::size_t work) { detail::parallelThresholdValue() = work; }
+
+/**
+ * GETTER
+ * @returns: The current parallel threshold, see setParallelThreshold().
+*/
+inline std::size_t parallelThreshold() { return detail::parallelThresholdValue(); }
+
+namespace detail {
+
+/**
+ * Multithreaded front end of gemm(): splits C into a 2D grid of tiles and runs the serial packed GEMM on each tile
+ * in the global pool. Row tiles are whole multiples of MC and column tiles multiples of NR so every tile keeps the
+ * packed kernel on its fast path; each worker packs into its own scratch buffers. Small products run serially.
+*/
+template<typename Scalar, typename LeftScalar, typename RightScalar>
+void gemmParallel(int m, int n, int k, Scalar alpha,
+                  const LeftScalar* a, std::ptrdiff_t rs_a, std::ptrdiff_t cs_a,
+                  const RightScalar* b, std::ptrdiff_t rs_b, std::ptrdiff_t cs_b,
+                  Scalar beta, Scalar* c, std::ptrdiff_t ldc) {
+   LINEAR_ALGEBRA_INSTRUMENT(Multiply, std::max(m, std::max(n, k)), 2.0 * m * n * k,
+                             double(m) * k * sizeof(LeftScalar) + double(k) * n * sizeof(RightScalar) +
+                             double(m) * n * sizeof(Scalar));
+   ThreadPool& pool = ThreadPool::global();
+   std::size_t work = static_cast<std::size_t>(std::max(m, 0)) * std::max(n, 0) * std::max(k, 1);
+   if (pool.size() == 1 || work < parallelThreshold()) {
+      gemm(m, n, k, alpha, a, rs_a, cs_a, b, rs_b, cs_b, beta, c, ldc);
+      return;
+   }
+
+   const int MC = GemmBlocking<Scalar>::MC, NR = GemmBlocking<Scalar>::NR;
+   const int target_tiles = 4 * pool.size();
+   int grid_m = std::min((m + MC - 1) / MC, target_tiles);
+   int tile_m = ((m + grid_m - 1) / grid_m + MC - 1) / MC * MC;
+   grid_m = (m + tile_m - 1) / tile_m;
+   int grid_n = std::min((target_tiles + grid_m - 1) / grid_m, (n + NR - 1) / NR);
+   int tile_n = ((n + grid_n - 1) / grid_n + NR - 1) / NR * NR;
+   grid_n = (n + tile_n - 1) / tile_n;
+
+   pool.parallelFor(grid_m * grid_n, [&](int tile) {
+      int i0 = (tile / grid_n) * tile_m, j0 = (tile % grid_n) * tile_n;
+      gemm(std::min(tile_m, m - i0), std::min(tile_n, n - j0), k, alpha,
+           a + i0 * rs_a, rs_a, cs_a, b + j0 * cs_b, rs_b, cs_b, beta, c + i0 * ldc + j0, ldc);
+   });
+}
+
+/**
+ * Multithreaded out-of-place transpose: hands square blocks of the source to the global pool, each of which is
+ * transposed by transposeRecursive().
+*/
+template<typename Scalar>
+void transposeParallel(int rows, int cols, const Scalar* src, std::ptrdiff_t lds, Scalar* dst, std::ptrdiff_t ldd) {
+   LINEAR_ALGEBRA_INSTRUMENT(TransposeInto, std::max(rows, cols), 0.0, 2.0 * rows * cols * sizeof(Scalar));
+   ThreadPool& pool = ThreadPool::global();
+   if (pool.size() == 1 || static_cast<std::size_t>(rows) * cols < parallelThreshold()) {
+      transposeRecursive(rows, cols, src, lds, dst, ldd);
+      return;
+   }
+   const int block = 256;
+   int grid_m = (rows + block - 1) / block, grid_n = (cols + block - 1) / block;
+   pool.parallelFor(grid_m * grid_n, [&](int tile) {
+      int i0 = (tile / grid_n) * block, j0 = (tile % grid_n) * block;
+      transposeRecursive(std::min(block, rows - i0), std::min(block, cols - j0),
+                         src + i0 * lds + j0, lds, dst + j0 * ldd + i0, ldd);
+   });
+}
+
+/**
+ * In-place transpose of an n x n matrix. Each task exchanges one tile row with the matching tile column, so tasks
+ * touch disjoint pairs of tiles and need no synchronization.
+*/
+template<typename Scalar>
+void transposeSquareParallel(int n, Scalar* a, std::ptrdiff_t lda) {
+   const int T = TransposeTile<Scalar>::size;
+   int block_rows = n / T;
+   ThreadPool& pool = ThreadPool::global();
+   if (pool.size() == 1 || static_cast<std::size_t>(n) * n < parallelThreshold()) {
+      for (int block = 0; block < block_rows; ++block) {
+         transposeSquareBlockRow(n, a, lda, block * T);
+      }
+   } else {
+      pool.parallelFor(block_rows, [&](int block) { transposeSquareBlockRow(n, a, lda, block * T); });
+   }
+   transposeSquareEdges(n, a, lda);
+}
+
+}  // End of namespace detail
+
+namespace detail {
+
+// Alignment of every Matrix buffer: one cache line, which also satisfies the widest (AVX-512) vector loads.
+const std::size_t kStorageAlignment = 64;
+
+// Pooled size classes hold 64 << c bytes for c in [0, kStorageSizeClasses); larger buffers bypass the pool.
+const int kStorageSizeClasses = 21;
+
+// Bytes a thread keeps cached in its pool before freed buffers go back to the system.
+const std::size_t kStoragePoolLimit = std::size_t(256) << 20;
+
+/**
+ * Bookkeeping stored in the cache line right before every Matrix buffer, so a buffer can be released with
+ * nothing but its data pointer.
+*/
+struct StorageHeader {
+   void* raw; // Pointer returned by malloc, null for arena buffers.
+   std::size_t capacity; // Usable bytes after the header.
+   std::size_t count; // Number of elements constructed in the buffer.
+   int size_class; // Pool size class, or -1 if the buffer bypasses the pool.
+};
+
+inline StorageHeader* headerOf(const void* data) {
+   return reinterpret_cast<StorageHeader*>(const_cast<char*>(static_cast<const char*>(data)) - kStorageAlignment);
+}
+
+// Allocates "bytes" usable bytes at a kStorageAlignment boundary with a header line in front of them.
+inline void* allocateAligned(std::size_t bytes, int size_class) {
+   if (bytes > std::numeric_limits<std::size_t>::max() - 2 * kStorageAlignment) {
+      throw std::bad_alloc();
+   }
+   void* raw = std::malloc(bytes + 2 * kStorageAlignment);
+   if (raw == nullptr) {
+      throw std::bad_alloc();
+   }
+   std::uintptr_t address = reinterpret_cast<std::uintptr_t>(raw) + kStorageAlignment;
+   address = (address + kStorageAlignment - 1) & ~static_cast<std::uintptr_t>(kStorageAlignment - 1);
+   void* data = reinterpret_cast<void*>(address);
+   StorageHeader* header = headerOf(data);
+   header->raw = raw;
+   header->capacity = bytes;
+   header->size_class = size_class;
+   return data;
+}
+
+/**
+ * Per-thread cache of freed Matrix buffers, one free list per power-of-two size class. Short-lived matrices of the
+ * same size reuse the same few buffers instead of going through malloc every time. A buffer released on another
+ * thread than the one that allocated it simply joins that thread's cache.
+*/
+class StoragePool
+{
+   private:
+      std::vector<void*> free_lists[kStorageSizeClasses];
+      std::size_t cached_bytes;
+
+      enum State { kUnused, kAlive, kDestroyed };
+
+      // Lifetime of the calling thread's pool. A plain thread_local flag has no destructor, so it can still be read
+      // after the pool itself is gone, e.g. when a static Matrix is destroyed after the main thread's thread_locals.
+      static State& state() {
+         thread_local State pool_state = kUnused;
+         return pool_state;
+      }
+
+   public:
+      StoragePool() : cached_bytes(0) { state() = kAlive; }
+
+      ~StoragePool() {
+         state() = kDestroyed;
+         for (auto& free_list : free_lists) {
+            for (void* data : free_list) {
+               std::free(headerOf(data)->raw);
+            }
+         }
+      }
+
+      static StoragePool& local() {
+         thread_local StoragePool pool;
+         return pool;
+      }
+
+      // Allocates from the calling thread's pool, or directly once that pool has been destroyed at thread exit.
+      static void* allocateLocal(std::size_t bytes) {
+         if (state() == kDestroyed) {
+            return allocateAligned(bytes, -1);
+         }
+         return local().allocate(bytes);
+      }
+
+      // Returns a buffer to the calling thread's pool, or frees it once that pool has been destroyed at thread exit.
+      static void releaseLocal(void* data) {
+         if (state() == kDestroyed) {
+            std::free(headerOf(data)->raw);
+            return;
+         }
+         local().release(data);
+      }
+
+      void* allocate(std::size_t bytes) {
+         int size_class = 0;
+         while (size_class < kStorageSizeClasses && (kStorageAlignment << size_class) < bytes) {
+            ++size_class;
+         }
+         if (size_class == kStorageSizeClasses) {
+            return allocateAligned(bytes, -1);
+         }
+         std::vector<void*>& free_list = free_lists[size_class];
+         if (!free_list.empty()) {
+            void* data = free_list.back();
+            free_list.pop_back();
+            cached_bytes -= headerOf(data)->capacity;
+            return data;
+         }
+         return allocateAligned(kStorageAlignment << size_class, size_class);
+      }
+
+      void release(void* data) {
+         StorageHeader* header = headerOf(data);
+         if (header->size_class < 0 || cached_bytes + header->capacity > kStoragePoolLimit) {
+            std::free(header->raw);
+            return;
+         }
+         cached_bytes += header->capacity;
+         free_lists[header->size_class].push_back(data);
+      }
+};
+
+}  // End of namespace detail
+
+/**
+ * Bump allocator for the Matrix buffers of one request.
+ *
+ * While a ScratchArena is alive, every Matrix allocated on the same thread (including results and temporaries)
+ * takes its buffer from the arena by bumping a pointer, and releasing such a buffer costs nothing. All of it is given
+ * back in bulk by reset() or when the arena is destroyed, so matrices allocated from an arena must not outlive it.
+ * Arenas nest: the innermost one on a thread is used, and allocations that do not fit fall back to the pool.
+ *
+ * Example:
+ *    {
+ *       LinearAlgebra::ScratchArena arena(64 << 20);
+ *       LinearAlgebra::Matrix<double> C = A * B; // C's buffer comes from the arena
+ *       ...
+ *    } // released in one go
+*/
+class ScratchArena
+{
+   private:
+      char* buffer;
+      std::size_t capacity;
+      std::size_t offset;
+      ScratchArena* previous;
+
+      static ScratchArena*& current() {
+         thread_local ScratchArena* arena = nullptr;
+         return arena;
+      }
+
+   public:
+      /**
+       * Constructor: Reserves the arena's memory and makes it the active arena of the calling thread.
+       * @param capacity_bytes: Total bytes available to matrices allocated while the arena is active.
+       */
+      explicit ScratchArena(std::size_t capacity_bytes)
+         : buffer(static_cast<char*>(detail::allocateAligned(capacity_bytes, -1))), capacity(capacity_bytes),
+           offset(0), previous(current()) {
+         current() = this;
+      }
+
+      ScratchArena(const ScratchArena&) = delete;
+      ScratchArena& operator=(const ScratchArena&) = delete;
+
+      // Destructor: Deactivates the arena and frees its memory. Arenas must be destroyed in reverse order of creation.
+      ~ScratchArena() {
+         current() = previous;
+         std::free(detail::headerOf(buffer)->raw);
+      }
+
+      /**
+       * Releases every buffer handed out so far. Matrices still using them must not be touched afterwards.
+       */
+      void reset() { offset = 0; }
+
+      std::size_t used() const { return offset; }
+      std::size_t getCapacity() const { return capacity; }
+
+      /**
+       * Takes "bytes" usable bytes (plus a header line) from the active arena of this thread.
+       * @returns: The aligned data pointer, or nullptr if there is no active arena or it is full.
+       */
+      static void* allocate(std::size_t bytes) {
+         ScratchArena* arena = current();
+         if (arena == nullptr || bytes > arena->capacity) {
+            return nullptr;
+         }
+         std::size_t rounded = (bytes + detail::kStorageAlignment - 1) & ~(detail::kStorageAlignment - 1);
+         if (arena->offset + detail::kStorageAlignment + rounded > arena->capacity) {
+            return nullptr;
+         }
+         char* data = arena->buffer + arena->offset + detail::kStorageAlignment;
+         arena->offset += detail::kStorageAlignment + rounded;
+         detail::StorageHeader* header = detail::headerOf(data);
+         header->raw = nullptr;
+         header->capacity = rounded;
+         header->size_class = -1;
+         return data;
+      }
+};
+
+namespace detail {
+
+/**
+ * Number of elements of a rows x cols matrix.
+ * @throws An invalid_argument exception if a dimension is negative.
+*/
+inline std::size_t elementCount(int rows, int cols) {
+   if (rows < 0 || cols < 0) {
+      throw std::invalid_argument("Matrix dimensions must not be negative");
+   }
+   return static_cast<std::size_t>(rows) * static_cast<std::size_t>(cols);
+}
+
+// Number of Matrix buffers handed out by allocateStorage() since program start, across all threads.
+inline std::atomic<std::size_t>& storageAllocationCounter() {
+   static std::atomic<std::size_t> counter(0);
+   return counter;
+}
+
+/**
+ * Allocates a 64-byte aligned buffer of "count" elements for a Matrix: from the thread's active ScratchArena if
+ * there is one with room, otherwise from the thread's StoragePool. Elements of trivial types are left uninitialized,
+ * just like new Scalar[count].
+ * @throws A bad_alloc exception if the buffer size in bytes, with its header, does not fit in a size_t.
+*/
+template<typename Scalar>
+Scalar* allocateStorage(std::size_t count) {
+   if (count > (std::numeric_limits<std::size_t>::max() - 2 * kStorageAlignment) / sizeof(Scalar)) {
+      throw std::bad_alloc();
+   }
+   LINEAR_ALGEBRA_INSTRUMENT(Allocate, count, 0.0, double(count) * sizeof(Scalar));
+   storageAllocationCounter().fetch_add(1, std::memory_order_relaxed);
+   std::size_t bytes = std::max<std::size_t>(count * sizeof(Scalar), 1);
+   void* data = ScratchArena::allocate(bytes);
+   if (data == nullptr) {
+      data = StoragePool::allocateLocal(bytes);
+   }
+   headerOf(data)->count = count;
+   Scalar* elements = static_cast<Scalar*>(data);
+   if (!std::is_trivial<Scalar>::value) {
+      for (std::size_t i = 0; i < count; ++i) {
+         new (elements + i) Scalar();
+      }
+   }
+   return elements;
+}
+
+// Returns a buffer obtained from allocateStorage(). Arena buffers are left for the arena to reclaim.
+template<typename Scalar>
+void releaseStorage(Scalar* data) {
+   if (data == nullptr) {
+      return;
+   }
+   StorageHeader* header = headerOf(data);
+   if (!std::is_trivial<Scalar>::value) {
+      for (std::size_t i = 0; i < header->count; ++i) {
+         data[i].~Scalar();
+      }
+   }
+   if (header->raw != nullptr) {
+      StoragePool::releaseLocal(data);
+   }
+}
+
+}  // End of namespace detail
+
+/**
+ * Get the number of matrix buffers allocated so far (pool or arena), e.g. to check that a loop does not allocate.
+ * Reuse of an existing buffer through resize(), copy assignment or moves is not counted.
+ * @returns: Count of calls to the storage allocator since program start.
+*/
+inline std::size_t storageAllocationCount() {
+   return detail::storageAllocationCounter().load(std::memory_order_relaxed);
+}
+
+template<typename Scalar> class Matrix;
+template<typename Scalar, int Rows, int Cols> class FixedMatrix;
+template<typename Scalar> class MappedMatrix;
+
+/**
+ * Base class of every lazily evaluated matrix expression (Curiously Recurring Template Pattern).
+ *
+ * Arithmetic on matrices does not compute anything by itself, it builds a small tree of expression nodes that is
+ * only evaluated when it is assigned to a Matrix. Elementwise trees (+, -, scaling, hadamard()) are evaluated in one
+ * fused loop over the flattened data without any temporaries, and a product plus an elementwise tree
+ * (e.g. alpha * A * B + beta * C) is evaluated as a single GEMM that accumulates into the destination.
+ * Expression nodes hold Matrix operands by reference, so an expression must not outlive the matrices it refers to
+ * (in particular, do not store one in an "auto" variable).
+*/
+template<typename Derived>
+class MatrixExpr
+{
+   public:
+      const Derived& derived() const { return static_cast<const Derived&>(*this); }
+};
+
+namespace detail {
+
+// Matrix leaves are held by reference, nested expression nodes are small temporaries and are held by value.
+template<typename Expr>
+struct ExprStorage {
+   typedef const Expr type;
+};
+
+template<typename Scalar>
+struct ExprStorage<Matrix<Scalar>> {
+   typedef const Matrix<Scalar>& type;
+};
+
+template<typename Scalar, int Rows, int Cols>
+struct ExprStorage<FixedMatrix<Scalar, Rows, Cols>> {
+   typedef const FixedMatrix<Scalar, Rows, Cols>& type;
+};
+
+template<typename Scalar>
+struct ExprStorage<MappedMatrix<Scalar>> {
+   typedef const MappedMatrix<Scalar>& type;
+};
+
+// Gives the library internals raw access to the flattened data of a Matrix.
+struct MatrixAccess {
+   template<typename Scalar>
+   static Scalar* data(Matrix<Scalar>& matrix) { return matrix.matrix_data; }
+
+   template<typename Scalar>
+   static const Scalar* data(const Matrix<Scalar>& matrix) { return matrix.matrix_data; }
+
+   template<typename Scalar>
+   static void reshapeDiscard(Matrix<Scalar>& matrix, int rows, int cols) { matrix.reshapeDiscard(rows, cols); }
+};
+
+// Keeps a function parameter out of template argument deduction.
+template<typename T>
+struct Identity {
+   typedef T type;
+};
+
+}  // End of namespace detail
+
+namespace detail {
+
+// Index check of the unchecked accessors, compiled out unless LINEAR_ALGEBRA_CHECK_BOUNDS is enabled.
+inline void debugCheckIndex(std::ptrdiff_t index, std::ptrdiff_t size) {
+#if LINEAR_ALGEBRA_CHECK_BOUNDS
+   if (index < 0 || index >= size) {
+      throw std::out_of_range("Specified index is out of bounds");
+   }
+#else
+   (void)index;
+   (void)size;
+#endif
+}
+
+}  // End of namespace detail
+
+/**
+ * Contiguous run of elements, e.g. one row of a Matrix (A.row(i)). Non-owning; its iterators are plain pointers, so
+ * loops and standard algorithms over a span compile to the same code as over a raw array.
+*/
+template<typename Scalar>
+class Span
+{
+   private:
+      Scalar* span_data;
+      std::size_t span_size;
+
+   public:
+      typedef typename std::remove_const<Scalar>::type value_type;
+      typedef Scalar* iterator;
+
+      Span(Scalar* data, std::size_t size) : span_data(data), span_size(size) {}
+
+      Scalar* data() const { return span_data; }
+      std::size_t size() const { return span_size; }
+      iterator begin() const { return span_data; }
+      iterator end() const { return span_data + span_size; }
+
+      // Element without bounds checks in release builds.
+      Scalar& operator[](std::size_t index) const {
+         detail::debugCheckIndex(static_cast<std::ptrdiff_t>(index), static_cast<std::ptrdiff_t>(span_size));
+         return span_data[index];
+      }
+};
+
+/**
+ * Random access iterator over elements a fixed stride apart, e.g. down a column of a row-major matrix. Keeps a base
+ * pointer and an index, so the end iterator never points outside the underlying buffer.
+*/
+template<typename Scalar>
+class StridedIterator
+{
+   template<typename OtherScalar> friend class StridedIterator;
+
+   private:
+      Scalar* base;
+      std::ptrdiff_t index;
+      std::ptrdiff_t stride;
+
+   public:
+      typedef std::random_access_iterator_tag iterator_category;
+      typedef typename std::remove_const<Scalar>::type value_type;
+      typedef std::ptrdiff_t difference_type;
+      typedef Scalar* pointer;
+      typedef Scalar& reference;
+
+      StridedIterator() : base(nullptr), index(0), stride(1) {}
+      StridedIterator(Scalar* input_base, std::ptrdiff_t input_index, std::ptrdiff_t input_stride)
+         : base(input_base), index(input_index), stride(input_stride) {}
+
+      // Converts a mutable iterator into a read-only one.
+      template<typename OtherScalar, typename = typename std::enable_if<std::is_same<const OtherScalar, Scalar>::value>::type>
+      StridedIterator(const StridedIterator<OtherScalar>& other) : base(other.base), index(other.index), stride(other.stride) {}
+
+      reference operator*() const { return base[index * stride]; }
+      pointer operator->() const { return base + index * stride; }
+      reference operator[](difference_type offset) const { return base[(index + offset) * stride]; }
+
+      StridedIterator& operator++() { ++index; return *this; }
+      StridedIterator& operator--() { --index; return *this; }
+      StridedIterator operator++(int) { StridedIterator old(*this); ++index; return old; }
+      StridedIterator operator--(int) { StridedIterator old(*this); --index; return old; }
+      StridedIterator& operator+=(difference_type offset) { index += offset; return *this; }
+      StridedIterator& operator-=(difference_type offset) { index -= offset; return *this; }
+
+      friend StridedIterator operator+(StridedIterator it, difference_type offset) { return it += offset; }
+      friend StridedIterator operator+(difference_type offset, StridedIterator it) { return it += offset; }
+      friend StridedIterator operator-(StridedIterator it, difference_type offset) { return it -= offset; }
+      friend difference_type operator-(const StridedIterator& left, const StridedIterator& right) {
+         return left.index - right.index;
+      }
+
+      // Iterators are only comparable within the same span.
+      friend bool operator==(const StridedIterator& left, const StridedIterator& right) { return left.index == right.index; }
+      friend bool operator!=(const StridedIterator& left, const StridedIterator& right) { return left.index != right.index; }
+      friend bool operator<(const StridedIterator& left, const StridedIterator& right) { return left.index < right.index; }
+      friend bool operator>(const StridedIterator& left, const StridedIterator& right) { return left.index > right.index; }
+      friend bool operator<=(const StridedIterator& left, const StridedIterator& right) { return left.index <= right.index; }
+      friend bool operator>=(const StridedIterator& left, const StridedIterator& right) { return left.index >= right.index; }
+};
+
+/**
+ * Elements a fixed stride apart, e.g. one column of a Matrix (A.col(j)) or a row of a transposed view. Non-owning,
+ * iterated with StridedIterator.
+*/
+template<typename Scalar>
+class StridedSpan
+{
+   private:
+      Scalar* span_data;
+      std::size_t span_size;
+      std::ptrdiff_t stride;
+
+   public:
+      typedef typename std::remove_const<Scalar>::type value_type;
+      typedef StridedIterator<Scalar> iterator;
+
+      StridedSpan(Scalar* data, std::size_t size, std::ptrdiff_t input_stride)
+         : span_data(data), span_size(size), stride(input_stride) {}
+
+      Scalar* data() const { return span_data; }
+      std::size_t size() const { return span_size; }
+      std::ptrdiff_t getStride() const { return stride; }
+      iterator begin() const { return iterator(span_data, 0, stride); }
+      iterator end() const { return iterator(span_data, static_cast<std::ptrdiff_t>(span_size), stride); }
+
+      // Element without bounds checks in release builds.
+      Scalar& operator[](std::size_t index) const {
+         detail::debugCheckIndex(static_cast<std::ptrdiff_t>(index), static_cast<std::ptrdiff_t>(span_size));
+         return span_data[static_cast<std::ptrdiff_t>(index) * stride];
+      }
+};
+
+/**
+ * Non-owning view of a matrix stored somewhere else: a Matrix's matrix_data or any external row-major buffer.
+ *
+ * A view is a pointer, a shape, the stride between stored rows and a transposed flag, so slicing out a block or
+ * flipping the orientation only changes those fields and never copies data. Views are accepted directly by the
+ * multiplication kernel (operator*, LinearAlgebra::gemm()), which reads a transposed view through swapped strides.
+ * Use MatrixView<const Scalar> for read-only data. A view must not outlive the storage it points to.
+*/
+template<typename Scalar>
+class MatrixView : public MatrixExpr<MatrixView<Scalar>>
+{
+   template<typename OtherScalar> friend class MatrixView;
+
+   private:
+
+      Scalar* view_data; // First element of the view.
+      int rows; // Number of rows as seen through the view (after transposition).
+      int cols; // Number of columns as seen through the view (after transposition).
+      std::ptrdiff_t stride; // Distance between consecutive rows of the underlying storage.
+      bool is_transposed; // Whether rows of the view are columns of the storage.
+
+      MatrixView(Scalar* data, int input_rows, int input_cols, std::ptrdiff_t input_stride, bool transposed)
+         : view_data(data), rows(input_rows), cols(input_cols), stride(input_stride), is_transposed(transposed) {}
+
+   public:
+      typedef typename std::remove_const<Scalar>::type scalar_type;
+
+      /**
+       * Constructor: View of a row-major buffer.
+       * @param data: Pointer to the first element.
+       * @param input_rows: Number of rows.
+       * @param input_cols: Number of columns.
+       * @param row_stride: Distance between consecutive rows in elements, defaults to input_cols (densely packed).
+       */
+      MatrixView(Scalar* data, int input_rows, int input_cols, std::ptrdiff_t row_stride = -1)
+         : view_data(data), rows(input_rows), cols(input_cols), stride(row_stride < 0 ? input_cols : row_stride),
+           is_transposed(false) {}
+
+      // Converts a mutable view into a read-only one.
+      template<typename OtherScalar, typename = typename std::enable_if<std::is_same<const OtherScalar, Scalar>::value>::type>
+      MatrixView(const MatrixView<OtherScalar>& other)
+         : view_data(other.view_data), rows(other.rows), cols(other.cols), stride(other.stride),
+           is_transposed(other.is_transposed) {}
+
+      int getRows() const { return rows; }
+      int getCols() const { return cols; }
+      Scalar* data() const { return view_data; }
+      std::ptrdiff_t getStride() const { return stride; }
+      bool isTransposed() const { return is_transposed; }
+
+      // Distance in elements between (i, j) and (i + 1, j) as seen through the view.
+      std::ptrdiff_t rowStep() const { return is_transposed ? 1 : stride; }
+
+      // Distance in elements between (i, j) and (i, j + 1) as seen through the view.
+      std::ptrdiff_t colStep() const { return is_transposed ? stride : 1; }
+
+      /**
+       * GETTER
+       * @param row: Row index within the view.
+       * @param col: Column index within the view.
+       * @throws An out_of_range exception if the input indexes are out of bounds.
+       * @returns: Value at the specified cell.
+       */
+      scalar_type get(int row, int col) const {
+         if (row < 0 || row >= rows || col < 0 || col >= cols) {
+            throw std::out_of_range("Specified index is out of bounds");
+         }
+         return view_data[row * rowStep() + col * colStep()];
+      }
+
+      /**
+       * SETTER
+       * @param row: Row index within the view.
+       * @param col: Column index within the view.
+       * @param value: Value written to the underlying storage.
+       * @throws An out_of_range exception if the input indexes are out of bounds.
+       */
+      void set(int row, int col, scalar_type value) const {
+         static_assert(!std::is_const<Scalar>::value, "Cannot write through a read-only view.");
+         if (row < 0 || row >= rows || col < 0 || col >= cols) {
+            throw std::out_of_range("Specified index is out of bounds");
+         }
+         view_data[row * rowStep() + col * colStep()] = value;
+      }
+
+      // Element at a flat row-major index of the view. Used when evaluating expressions.
+      scalar_type coeff(std::size_t index) const {
+         std::ptrdiff_t row = static_cast<std::ptrdiff_t>(index / cols), col = static_cast<std::ptrdiff_t>(index % cols);
+         return view_data[row * rowStep() + col * colStep()];
+      }
+
+      // Element (row, col) by reference, checked only in debug builds (see LINEAR_ALGEBRA_CHECK_BOUNDS).
+      Scalar& operator()(int row, int col) const {
+         detail::debugCheckIndex(row, rows);
+         detail::debugCheckIndex(col, cols);
+         return view_data[row * rowStep() + col * colStep()];
+      }
+
+      /**
+       * Row or column of the view as a strided range, e.g. std::accumulate(v.col(j).begin(), v.col(j).end(), 0.0).
+       * @param index: Row or column index within the view, checked only in debug builds.
+       * @returns: Span over the elements, contiguous (stride 1) for rows of a view that is not transposed.
+       */
+      StridedSpan<Scalar> row(int index) const {
+         detail::debugCheckIndex(index, rows);
+         return StridedSpan<Scalar>(view_data + index * rowStep(), cols, colStep());
+      }
+
+      StridedSpan<Scalar> col(int index) const {
+         detail::debugCheckIndex(index, cols);
+         return StridedSpan<Scalar>(view_data + index * colStep(), rows, rowStep());
+      }
+
+      /**
+       * Sub-block of this view. No data is copied.
+       * @param first_row: Row of the view where the block starts.
+       * @param first_col: Column of the view where the block starts.
+       * @param block_rows: Number of rows in the block.
+       * @param block_cols: Number of columns in the block.
+       * @throws An out_of_range exception if the block does not fit inside the view.
+       * @returns: View of the block.
+       */
+      MatrixView block(int first_row, int first_col, int block_rows, int block_cols) const {
+         if (first_row < 0 || first_col < 0 || block_rows < 0 || block_cols < 0 ||
+             first_row + block_rows > rows || first_col + block_cols > cols) {
+            throw std::out_of_range("Block exceeds view dimensions");
+         }
+         return MatrixView(view_data + first_row * rowStep() + first_col * colStep(), block_rows, block_cols,
+                           stride, is_transposed);
+      }
+
+      /**
+       * Lazy transpose. No data is copied, the returned view reads the same storage with rows and columns swapped.
+       * @returns: The transposed view.
+       */
+      MatrixView transposed() const {
+         return MatrixView(view_data, cols, rows, stride, !is_transposed);
+      }
+
+      // True if any element of the view lies inside [begin, begin + size).
+      bool overlaps(const scalar_type* begin, std::size_t size) const {
+         if (rows == 0 || cols == 0 || size == 0) {
+            return false;
+         }
+         const scalar_type* last = view_data + (rows - 1) * rowStep() + (cols - 1) * colStep();
+         std::less<const scalar_type*> less;
+         return !less(last, begin) && less(view_data, begin + size);
+      }
+};
+
+namespace detail {
+
+/**
+ * Element type codes of the binary matrix format. Integer codes are 1 + log2(size) for signed and 5 + log2(size)
+ * for unsigned types, floating point types use 9 (32-bit), 10 (64-bit), 11 (BFloat16) and 12 (Float16).
+ * 0 marks a type that cannot be stored.
+*/
+constexpr std::uint32_t log2Size(std::size_t size) {
+   return size <= 1 ? 0 : 1 + log2Size(size / 2);
+}
+
+template<typename Scalar>
+struct DataTypeOf {
+   static const std::uint32_t code =
+      std::is_same<Scalar, bool>::value ? 0 :
+      std::is_integral<Scalar>::value && sizeof(Scalar) <= 8 ? (std::is_signed<Scalar>::value ? 1 : 5) + log2Size(sizeof(Scalar)) :
+      std::is_same<Scalar, float>::value ? 9 :
+      std::is_same<Scalar, double>::value ? 10 :
+      std::is_same<Scalar, BFloat16>::value ? 11 :
+      std::is_same<Scalar, Float16>::value ? 12 : 0;
+};
+
+const char kBinaryMagic[8] = {'L', 'A', 'M', 'A', 'T', 'R', 'I', 'X'};
+const std::uint32_t kBinaryVersion = 1;
+const std::uint32_t kBinaryByteOrder = 0x01020304;
+
+/**
+ * Header at the start of a binary matrix file. All fields are in the byte order of the machine that wrote the file
+ * (recorded in byte_order). Element (i, j) is stored at data_offset + (i * row_stride + j * col_stride) *
+ * element_size; save() writes dense row-major data (row_stride = cols, col_stride = 1) starting at a 64-byte
+ * aligned offset, so a mapped file can be handed to the SIMD kernels as is.
+*/
+struct BinaryHeader {
+   char magic[8]; // kBinaryMagic.
+   std::uint32_t version; // kBinaryVersion.
+   std::uint32_t byte_order; // kBinaryByteOrder as written by the saving machine.
+   std::uint32_t data_type; // DataTypeOf<Scalar>::code.
+   std::uint32_t element_size; // sizeof(Scalar) in bytes.
+   std::uint32_t alignment; // Alignment of data_offset in bytes.
+   std::uint32_t reserved;
+   std::int64_t rows;
+   std::int64_t cols;
+   std::int64_t row_stride; // Distance between (i, j) and (i + 1, j) in elements.
+   std::int64_t col_stride; // Distance between (i, j) and (i, j + 1) in elements.
+   std::uint64_t data_offset; // Offset of element (0, 0) from the start of the file in bytes.
+   char padding[56];
+};
+
+static_assert(sizeof(BinaryHeader) == 128, "Binary matrix header must be 128 bytes.");
+
+/**
+ * Checks that "header" describes a Scalar matrix whose elements all lie inside a file of file_size bytes.
+ * @throws An invalid_argument exception naming "path" if the file is not a matrix file of this type.
+ * @returns: Number of bytes from data_offset to the end of the last element.
+*/
+template<typename Scalar>
+std::uint64_t checkBinaryHeader(const BinaryHeader& header, std::uint64_t file_size, const std::string& path) {
+   if (file_size < sizeof(BinaryHeader) || std::memcmp(header.magic, kBinaryMagic, sizeof(kBinaryMagic)) != 0) {
+      throw std::invalid_argument(path + " is not a matrix file");
+   }
+   if (header.version != kBinaryVersion || header.byte_order != kBinaryByteOrder) {
+      throw std::invalid_argument(path + " has an unsupported version or byte order");
+   }
+   if (header.data_type != DataTypeOf<Scalar>::code || header.element_size != sizeof(Scalar)) {
+      throw std::invalid_argument(path + " holds a different element type than the matrix's Scalar type");
+   }
+   const std::int64_t max_dimension = std::numeric_limits<int>::max();
+   if (header.rows < 0 || header.cols < 0 || header.rows > max_dimension || header.cols > max_dimension ||
+       !((header.col_stride == 1 && header.row_stride >= header.cols) ||
+         (header.row_stride == 1 && header.col_stride >= header.rows)) ||
+       header.data_offset % sizeof(Scalar) != 0) {
+      throw std::invalid_argument(path + " has an invalid matrix layout");
+   }
+   if (header.data_offset > file_size) {
+      throw std::invalid_argument(path + " is truncated");
+   }
+   if (header.rows == 0 || header.cols == 0) {
+      return 0;
+   }
+   // Each stride term of the extent must stay below the number of stored elements. Checking that by division keeps
+   // corrupt strides from wrapping the extent around in 64-bit arithmetic.
+   const std::uint64_t available = (file_size - header.data_offset) / sizeof(Scalar);
+   const std::uint64_t last_row = static_cast<std::uint64_t>(header.rows - 1), last_col = static_cast<std::uint64_t>(header.cols - 1);
+   const std::uint64_t row_stride = static_cast<std::uint64_t>(header.row_stride);
+   const std::uint64_t col_stride = static_cast<std::uint64_t>(header.col_stride);
+   if (available == 0 || (last_row > 0 && row_stride > (available - 1) / last_row) ||
+       (last_col > 0 && col_stride > (available - 1) / last_col)) {
+      throw std::invalid_argument(path + " is truncated");
+   }
+   const std::uint64_t elements = last_row * row_stride + last_col * col_stride + 1;
+   if (elements > available) {
+      throw std::invalid_argument(path + " is truncated");
+   }
+   return elements * sizeof(Scalar);
+}
+
+// View of the elements of a checked header whose data starts at "data".
+template<typename Scalar>
+MatrixView<const Scalar> binaryView(const BinaryHeader& header, const Scalar* data) {
+   int rows = static_cast<int>(header.rows), cols = static_cast<int>(header.cols);
+   if (header.col_stride == 1) {
+      return MatrixView<const Scalar>(data, rows, cols, header.row_stride);
+   }
+   // Column-major data: a view of the stored transpose, flipped back.
+   return MatrixView<const Scalar>(data, cols, rows, header.col_stride).transposed();
+}
+
+/**
+ * Writes "view" to "path" in the binary matrix format as dense row-major data.
+ * @throws A runtime_error exception if the file cannot be written.
+*/
+template<typename Scalar>
+void writeBinary(const std::string& path, const MatrixView<const Scalar>& view) {
+   static_assert(DataTypeOf<Scalar>::code != 0, "Scalar type has no binary file representation.");
+   LINEAR_ALGEBRA_INSTRUMENT(FileIO, std::max(view.getRows(), view.getCols()), 0.0,
+                             sizeof(BinaryHeader) + double(view.getRows()) * view.getCols() * sizeof(Scalar));
+   BinaryHeader header;
+   std::memset(&header, 0, sizeof(header));
+   std::memcpy(header.magic, kBinaryMagic, sizeof(kBinaryMagic));
+   header.version = kBinaryVersion;
+   header.byte_order = kBinaryByteOrder;
+   header.data_type = DataTypeOf<Scalar>::code;
+   header.element_size = sizeof(Scalar);
+   header.alignment = kStorageAlignment;
+   header.rows = view.getRows();
+   header.cols = view.getCols();
+   header.row_stride = view.getCols();
+   header.col_stride = 1;
+   header.data_offset = sizeof(BinaryHeader);
+
+   std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+   file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+   std::streamsize row_bytes = static_cast<std::streamsize>(view.getCols()) * sizeof(Scalar);
+   if (!view.isTransposed() && view.getStride() == view.getCols()) {
+      file.write(reinterpret_cast<const char*>(view.data()), row_bytes * view.getRows());
+   } else {
+      std::vector<Scalar> row(view.getCols());
+      for (int i = 0; i < view.getRows(); ++i) {
+         for (int j = 0; j < view.getCols(); ++j) {
+            row[j] = view.data()[i * view.rowStep() + j * view.colStep()];
+         }
+         file.write(reinterpret_cast<const char*>(row.data()), row_bytes);
+      }
+   }
+   file.close();
+   if (!file) {
+      throw std::runtime_error("Cannot write matrix file " + path);
+   }
+}
+
+// Formats one element the way operator<< would with the stream's precision and fixed/scientific setting.
+template<typename Scalar>
+int formatElement(char* out, std::size_t size, Scalar value, const char* format, int precision,
+                  typename std::enable_if<std::is_floating_point<Scalar>::value>::type* = nullptr) {
+   return std::snprintf(out, size, format, precision, static_cast<long double>(value));
+}
+
+template<typename Scalar>
+int formatElement(char* out, std::size_t size, Scalar value, const char*, int,
+                  typename std::enable_if<std::is_integral<Scalar>::value && std::is_signed<Scalar>::value>::type* = nullptr) {
+   return std::snprintf(out, size, "%lld ", static_cast<long long>(value));
+}
+
+template<typename Scalar>
+int formatElement(char* out, std::size_t size, Scalar value, const char*, int,
+                  typename std::enable_if<std::is_integral<Scalar>::value && !std::is_signed<Scalar>::value>::type* = nullptr) {
+   return std::snprintf(out, size, "%llu ", static_cast<unsigned long long>(value));
+}
+
+// Text output through the stream itself, for element types and stream settings the fast path does not reproduce.
+template<typename Scalar>
+void writeTextSlow(std::ostream& os, const MatrixView<const Scalar>& view) {
+   for (int i = 0; i < view.getRows(); ++i) {
+      for (int j = 0; j < view.getCols(); ++j) {
+         os << view.data()[i * view.rowStep() + j * view.colStep()] << " ";
+      }
+      os << '\n';
+   }
+}
+
+template<typename Scalar>
+void writeText(std::ostream& os, const MatrixView<const Scalar>& view, std::false_type) {
+   writeTextSlow(os, view);
+}
+
+template<typename Scalar>
+void writeText(std::ostream& os, const MatrixView<const Scalar>& view, std::true_type) {
+   std::ios_base::fmtflags flags = os.flags();
+   std::ios_base::fmtflags float_field = flags & std::ios_base::floatfield;
+   if ((flags & (std::ios_base::showpos | std::ios_base::showpoint | std::ios_base::uppercase |
+                 std::ios_base::showbase)) != 0 ||
+       ((flags & std::ios_base::basefield) != std::ios_base::dec && (flags & std::ios_base::basefield) != 0) ||
+       float_field == (std::ios_base::fixed | std::ios_base::scientific) || os.getloc() != std::locale::classic() ||
+       os.width() != 0) {
+      writeTextSlow(os, view);
+      return;
+   }
+   const char* format = float_field == std::ios_base::fixed ? "%.*Lf " :
+                        float_field == std::ios_base::scientific ? "%.*Le " : "%.*Lg ";
+   int precision = static_cast<int>(os.precision());
+   const std::size_t kBufferSize = 1 << 16;
+   std::vector<char> buffer(kBufferSize);
+   std::size_t used = 0;
+   for (int i = 0; i < view.getRows(); ++i) {
+      for (int j = 0; j < view.getCols(); ++j) {
+         Scalar value = view.data()[i * view.rowStep() + j * view.colStep()];
+         int length = formatElement(buffer.data() + used, kBufferSize - used, value, format, precision);
+         if (length < 0 || static_cast<std::size_t>(length) >= kBufferSize - used) {
+            os.write(buffer.data(), used);
+            used = 0;
+            length = formatElement(buffer.data(), kBufferSize, value, format, precision);
+            if (length < 0 || static_cast<std::size_t>(length) >= kBufferSize) {
+               os << value << " ";
+               length = 0;
+            }
+         }
+         used += length;
+      }
+      if (used + 1 >= kBufferSize) {
+         os.write(buffer.data(), used);
+         used = 0;
+      }
+      buffer[used++] = '\n';
+   }
+   os.write(buffer.data(), used);
+}
+
+/**
+ * Writes a matrix as text, one row per line with every element followed by a space, exactly like streaming each
+ * element with operator<<. Arithmetic types are formatted into a local buffer that is written in large chunks and
+ * the stream is never flushed.
+*/
+template<typename Scalar>
+void writeText(std::ostream& os, const MatrixView<const Scalar>& view) {
+   writeText(os, view, std::integral_constant<bool, std::is_floating_point<Scalar>::value ||
+                                                    (std::is_integral<Scalar>::value && sizeof(Scalar) > 1 &&
+                                                     !std::is_same<Scalar, bool>::value)>());
+}
+
+}  // End of namespace detail
+
+/**
+ * Read-only matrix opened directly over a binary matrix file (see Matrix::save()). The file is memory-mapped, so
+ * opening it costs no parsing and no copy regardless of its size, and pages are only read from disk when they are
+ * touched. Can be used wherever a matrix expression is accepted, e.g. Matrix<float> y = weights * x.
+ * Move-only, the mapping is released by the destructor. On platforms without mmap the file is read into memory.
+*/
+template<typename Scalar>
+class MappedMatrix : public MatrixExpr<MappedMatrix<Scalar>>
+{
+   private:
+
+      void* mapping; // Start of the mapped file, or of the heap copy without mmap.
+      std::size_t mapping_size; // Size of the mapping in bytes.
+      MatrixView<const Scalar> matrix_view; // The elements inside the mapping.
+
+      void release() {
+         if (mapping == nullptr) {
+            return;
+         }
+#if LINEAR_ALGEBRA_HAS_MMAP
+         munmap(mapping, mapping_size);
+#else
+         std::free(detail::headerOf(mapping)->raw);
+#endif
+         mapping = nullptr;
+      }
+
+   public:
+      typedef Scalar scalar_type;
+
+      /**
+       * Constructor: Maps a binary matrix file read-only.
+       * @param path: File written by Matrix::save().
+       * @throws A runtime_error exception if the file cannot be opened or mapped, and an invalid_argument exception
+       *    if it is not a matrix file of this Scalar type.
+       */
+      explicit MappedMatrix(const std::string& path) : mapping(nullptr), mapping_size(0), matrix_view(nullptr, 0, 0) {
+         static_assert(detail::DataTypeOf<Scalar>::code != 0, "Scalar type has no binary file representation.");
+#if LINEAR_ALGEBRA_HAS_MMAP
+         int descriptor = open(path.c_str(), O_RDONLY);
+         struct stat status;
+         if (descriptor < 0 || fstat(descriptor, &status) != 0) {
+            if (descriptor >= 0) {
+               close(descriptor);
+            }
+            throw std::runtime_error("Cannot open matrix file " + path);
+         }
+         mapping_size = static_cast<std::size_t>(status.st_size);
+         void* address = mapping_size == 0 ? MAP_FAILED : ::mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, descriptor, 0);
+         close(descriptor);
+         if (address == MAP_FAILED) {
+            throw std::runtime_error("Cannot map matrix file " + path);
+         }
+         mapping = address;
+#else
+         std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+         if (!file) {
+            throw std::runtime_error("Cannot open matrix file " + path);
+         }
+         mapping_size = static_cast<std::size_t>(file.tellg());
+         mapping = detail::allocateAligned(mapping_size, -1);
+         file.seekg(0);
+         if (!file.read(static_cast<char*>(mapping), mapping_size)) {
+            release();
+            throw std::runtime_error("Cannot read matrix file " + path);
+         }
+#endif
+         try {
+            if (mapping_size < sizeof(detail::BinaryHeader)) {
+               throw std::invalid_argument(path + " is not a matrix file");
+            }
+            const detail::BinaryHeader& header = *static_cast<const detail::BinaryHeader*>(mapping);
+            detail::checkBinaryHeader<Scalar>(header, mapping_size, path);
+            matrix_view = detail::binaryView(header, reinterpret_cast<const Scalar*>(static_cast<const char*>(mapping) + header.data_offset));
+         } catch (...) {
+            release();
+            throw;
+         }
+      }
+
+      MappedMatrix(MappedMatrix&& other) noexcept
+         : mapping(other.mapping), mapping_size(other.mapping_size), matrix_view(other.matrix_view) {
+         other.mapping = nullptr;
+         other.matrix_view = MatrixView<const Scalar>(nullptr, 0, 0);
+      }
+
+      MappedMatrix& operator=(MappedMatrix&& other) noexcept {
+         if (this != &other) {
+            release();
+            mapping = other.mapping;
+            mapping_size = other.mapping_size;
+            matrix_view = other.matrix_view;
+            other.mapping = nullptr;
+            other.matrix_view = MatrixView<const Scalar>(nullptr, 0, 0);
+         }
+         return *this;
+      }
+
+      MappedMatrix(const MappedMatrix&) = delete;
+      MappedMatrix& operator=(const MappedMatrix&) = delete;
+
+      ~MappedMatrix() { release(); }
+
+      int getRows() const { return matrix_view.getRows(); }
+      int getCols() const { return matrix_view.getCols(); }
+
+      // Read-only view of the mapped elements, valid as long as this object is alive.
+      MatrixView<const Scalar> view() const { return matrix_view; }
+
+      // Element at a flat row-major index. Used when evaluating expressions.
+      Scalar coeff(std::size_t index) const { return matrix_view.coeff(index); }
+
+      /**
+       * GETTER
+       * Get the value of a specific cell in the matrix.
+       * @param row: Row index of the cell.
+       * @param col: Column index of the cell.
+       * @throws An out_of_range exception if the input indexes are out of bounds.
+       * @returns: Value at the specified cell in the matrix.
+       */
+      Scalar get(int row, int col) const { return matrix_view.get(row, col); }
+
+      friend std::ostream& operator<< (std::ostream& os, const MappedMatrix& matrix) {
+         detail::writeText(os, matrix.matrix_view);
+         return os;
+      }
+};
+
+namespace detail {
+
+// True if any element of the view lies inside [begin, begin + size). A view of another element type never does.
+template<typename Scalar>
+bool viewOverlaps(const MatrixView<const Scalar>& view, const Scalar* begin, std::size_t size) {
+   return view.overlaps(begin, size);
+}
+
+template<typename ViewScalar, typename Scalar>
+bool viewOverlaps(const MatrixView<const ViewScalar>&, const Scalar*, std::size_t) {
+   return false;
+}
+
+}  // End of namespace detail
+
+/**
+ * Lazy product alpha * left * right. Operands that are not plain matrices (e.g. (A + B) * C) are evaluated once
+ * into a buffer owned by the node. Move-only, since the operands may point into that buffer.
+ * Scalar is the type of the result and of the accumulation, LeftScalar and RightScalar the element types of the
+ * operands, which differ from Scalar in mixed-type products (see ProductScalar).
+*/
+template<typename Scalar, typename LeftScalar = Scalar, typename RightScalar = Scalar>
+class ProductExpr
+{
+   private:
+      MatrixView<const LeftScalar> left_operand;
+      MatrixView<const RightScalar> right_operand;
+      Scalar alpha;
+      std::vector<LeftScalar> left_storage;
+      std::vector<RightScalar> right_storage;
+
+   public:
+      typedef Scalar scalar_type;
+
+      ProductExpr(const MatrixView<const LeftScalar>& left, const MatrixView<const RightScalar>& right, Scalar input_alpha,
+                  std::vector<LeftScalar>&& input_left_storage, std::vector<RightScalar>&& input_right_storage)
+         : left_operand(left), right_operand(right), alpha(input_alpha),
+           left_storage(std::move(input_left_storage)), right_storage(std::move(input_right_storage)) {}
+
+      ProductExpr(ProductExpr&&) = default;
+      ProductExpr(const ProductExpr&) = delete;
+      ProductExpr& operator=(const ProductExpr&) = delete;
+
+      int getRows() const { return left_operand.getRows(); }
+      int getCols() const { return right_operand.getCols(); }
+      Scalar getAlpha() const { return alpha; }
+
+      // Returns this product with alpha multiplied by "factor".
+      ProductExpr scaled(Scalar factor) && {
+         alpha *= factor;
+         return std::move(*this);
+      }
+
+      // True if writing to [data, data + size) would change an operand while the product is being computed.
+      bool aliases(const Scalar* data, std::size_t size) const {
+         return detail::viewOverlaps(left_operand, data, size) || detail::viewOverlaps(right_operand, data, size);
+      }
+
+      /**
+       * Computes dst = scale * alpha * left * right + beta * dst, dst being a row-major getRows() x getCols() buffer.
+      */
+      void evaluateInto(Scalar beta, Scalar* dst, Scalar scale = Scalar(1)) const {
+         detail::gemmParallel(getRows(), getCols(), left_operand.getCols(), scale * alpha,
+                              left_operand.data(), left_operand.rowStep(), left_operand.colStep(),
+                              right_operand.data(), right_operand.rowStep(), right_operand.colStep(),
+                              beta, dst, getCols());
+      }
+
+      /**
+       * GETTER
+       * Computes a single element of the product as a dot product of a row and a column, without evaluating the rest.
+       * @param row: Row index of the cell.
+       * @param col: Column index of the cell.
+       * @throws An out_of_range exception if the input indexes are out of bounds.
+       * @returns: Value at the specified cell of the product.
+       */
+      Scalar get(int row, int col) const {
+         if (row < 0 || row >= getRows() || col < 0 || col >= getCols()) {
+            throw std::out_of_range("Specified index is out of bounds");
+         }
+         const LeftScalar* a = left_operand.data() + row * left_operand.rowStep();
+         const RightScalar* b = right_operand.data() + col * right_operand.colStep();
+         Scalar sum(0);
+         for (int p = 0; p < left_operand.getCols(); ++p) {
+            sum += static_cast<Scalar>(a[p * left_operand.colStep()]) * static_cast<Scalar>(b[p * right_operand.rowStep()]);
+         }
+         return alpha * sum;
+      }
+
+      /**
+       * Evaluates the product into a new Matrix, e.g. to pass it to a function template taking a Matrix<Scalar>.
+       * @returns: The product.
+       */
+      Matrix<Scalar> eval() const { return Matrix<Scalar>(*this); }
+
+      friend std::ostream& operator<< (std::ostream& os, const ProductExpr& product) {
+         return os << product.eval();
+      }
+};
+
+/**
+ * Lazy alpha * A * B + beta * addend, evaluated as one GEMM that accumulates into the destination.
+*/
+template<typename Scalar, typename Addend, typename LeftScalar = Scalar, typename RightScalar = Scalar>
+class GemmExpr
+{
+   static_assert(std::is_same<Scalar, typename Addend::scalar_type>::value,
+                 "Addend is of a different type than the product's Scalar type.");
+
+   private:
+      ProductExpr<Scalar, LeftScalar, RightScalar> product_expr;
+      typename detail::ExprStorage<Addend>::type addend_expr;
+      Scalar beta;
+
+   public:
+      GemmExpr(ProductExpr<Scalar, LeftScalar, RightScalar>&& product, const Addend& addend, Scalar input_beta)
+         : product_expr(std::move(product)), addend_expr(addend), beta(input_beta) {
+         if (addend.getRows() != product_expr.getRows() || addend.getCols() != product_expr.getCols()) {
+            throw std::invalid_argument("Matrices are not conformant for addition");
+         }
+      }
+
+      GemmExpr(GemmExpr&&) = default;
+
+      int getRows() const { return product_expr.getRows(); }
+      int getCols() const { return product_expr.getCols(); }
+      const ProductExpr<Scalar, LeftScalar, RightScalar>& product() const { return product_expr; }
+      ProductExpr<Scalar, LeftScalar, RightScalar>&& takeProduct() && { return std::move(product_expr); }
+      const Addend& addend() const { return addend_expr; }
+      Scalar getBeta() const { return beta; }
+};
+
+/**
+ * Lazy sum of two products, A * B + C * D; for A * B - C * D the second product's alpha carries the sign.
+ * Evaluated as two GEMMs, the first writing the destination and the second accumulating into it with beta = 1.
+*/
+template<typename First, typename Second>
+class ProductSumExpr
+{
+   static_assert(std::is_same<typename First::scalar_type, typename Second::scalar_type>::value,
+                 "Products of different Scalar types cannot be added.");
+
+   private:
+      First first_product;
+      Second second_product;
+
+   public:
+      typedef typename First::scalar_type scalar_type;
+
+      ProductSumExpr(First&& first, Second&& second) : first_product(std::move(first)), second_product(std::move(second)) {
+         if (first_product.getRows() != second_product.getRows() || first_product.getCols() != second_product.getCols()) {
+            throw std::invalid_argument("Matrices are not conformant for addition");
+         }
+      }
+
+      ProductSumExpr(ProductSumExpr&&) = default;
+
+      int getRows() const { return first_product.getRows(); }
+      int getCols() const { return first_product.getCols(); }
+
+      // True if writing to [data, data + size) would change an operand of either product.
+      bool aliases(const scalar_type* data, std::size_t size) const {
+         return first_product.aliases(data, size) || second_product.aliases(data, size);
+      }
+
+      // Computes dst = first + second into a row-major getRows() x getCols() buffer that no operand aliases.
+      void evaluateInto(scalar_type* dst) const {
+         first_product.evaluateInto(scalar_type(0), dst);
+         second_product.evaluateInto(scalar_type(1), dst);
+      }
+};
+
+// Class for representing a matrix with generic Scalar type, this can include int, double, float etc.
+template<typename Scalar> 
+class Matrix : public MatrixExpr<Matrix<Scalar>>
+{
+   friend struct detail::MatrixAccess;
+
+   protected:
+      
+      Scalar* matrix_data; // Pointer to the flattened matrix data.
+      int rows; // Number of rows in the matrix.
+      int cols; // Number of columns in the matrix.
+      std::size_t storage_capacity; // Number of elements matrix_data has room for, at least rows * cols.
+
+      /**
+       * Helper function to initialize matrix_data from a 2D range (like 2D vector or initializer list).
+       * 
+       * @param input_list: Either a 2D vector or nested initializer list
+       * @throws Throws an exception if the provided range exceeds matrix dimensions 
+       *    or if the number of elements in a data row is incorrect.
+      */ 
+      template<typename RangeType>
+      void initializeFrom2DRange(const RangeType& input_list) {
+         int row = 0;
+         for (const auto& curr_row : input_list) {
+            int col = 0;
+            for (const auto& elem : curr_row) {
+               if (row >= rows || col >= cols) {
+                  throw std::out_of_range("Data exceeds matrix dimensions");
+               }
+               matrix_data[row * cols + col] = elem;
+               col++;
+            }
+            if (col != cols) {
+               throw std::invalid_argument("Incorrect number of elements in data row");
+            }
+            row++;
+         }
+      }
+
+      // Exchanges buffers and dimensions with another matrix.
+      void swapData(Matrix<Scalar>& other) noexcept {
+         std::swap(matrix_data, other.matrix_data);
+         std::swap(rows, other.rows);
+         std::swap(cols, other.cols);
+         std::swap(storage_capacity, other.storage_capacity);
+      }
+
+      /**
+       * Changes the dimensions for a result that is about to overwrite every element: like resize(), but a new buffer
+       * is not filled with the old contents.
+       * @throws An invalid_argument exception if a dimension is negative.
+       */
+      void reshapeDiscard(int new_rows, int new_cols) {
+         std::size_t count = detail::elementCount(new_rows, new_cols);
+         if (count > storage_capacity) {
+            Scalar* new_data = detail::allocateStorage<Scalar>(count);
+            detail::releaseStorage(matrix_data);
+            matrix_data = new_data;
+            storage_capacity = count;
+         }
+         rows = new_rows;
+         cols = new_cols;
+      }
+
+   public:
+      typedef Scalar scalar_type;
+
+      /**
+       * Default Constructor: Initialize an empty matrix with specified dimensions.
+       * @param input_rows: Number of rows for the new matrix.
+       * @param input_cols: Number of columns for the new matrix.
+       * @throws An invalid_argument exception if a dimension is negative.
+       */
+      Matrix(int input_rows, int input_cols) 
+         : matrix_data(detail::allocateStorage<Scalar>(detail::elementCount(input_rows, input_cols))), rows(input_rows),
+           cols(input_cols), storage_capacity(static_cast<std::size_t>(input_rows) * input_cols) {}
+
+       /**
+       * Constructor to initialize matrix using an initializer list.
+       * 
+       * Example: LinearAlgebra::Matrix<int> matrix(2, 2, {{1, 2}, {3, 4}});
+       * 
+       * @param input_rows: Number of rows for the new matrix.
+       * @param input_cols: Number of columns for the new matrix.
+       * @param init_list: Initializer list to populate the matrix.
+       */
+      Matrix(int input_rows, int input_cols, std::initializer_list<std::initializer_list<Scalar>> init_list) 
+         : Matrix(input_rows, input_cols) {
+         initializeFrom2DRange(init_list);
+      }
+
+      /**
+       * Constructor to initialize matrix using a 2D vector.
+       * @param input_rows: Number of rows for the matrix.
+       * @param input_cols: Number of columns for the matrix.
+       * @param input_vector: 2D vector to populate the matrix.
+       */
+      Matrix(int input_rows, int input_cols, const std::vector<std::vector<Scalar>>& input_vector) 
+         : Matrix(input_rows, input_cols) {
+         initializeFrom2DRange(input_vector);
+      }
+
+      /**
+       * Copy constructor.
+       * @param other: Another matrix object to be copied.
+       */
+      Matrix(const Matrix<Scalar>& other) 
+         : Matrix(other.rows, other.cols) {
+         LINEAR_ALGEBRA_INSTRUMENT(Copy, static_cast<std::size_t>(rows) * cols, 0.0, double(rows) * cols * sizeof(Scalar));
+         std::copy(other.matrix_data, other.matrix_data + static_cast<std::size_t>(rows) * cols, matrix_data);
+      }
+
+      /**
+       * Move constructor for efficient matrix creation by moving data. O(1), no allocation.
+       * @param other: Another matrix object, left as an empty 0 x 0 matrix without a buffer.
+       */
+      Matrix(Matrix<Scalar>&& other) noexcept
+         : matrix_data(other.matrix_data), rows(other.rows), cols(other.cols), storage_capacity(other.storage_capacity) {
+         other.matrix_data = nullptr;
+         other.rows = 0;
+         other.cols = 0;
+         other.storage_capacity = 0;
+      }
+      
+      /**
+       * Constructors that evaluate a matrix expression, e.g. LinearAlgebra::Matrix<double> C = A + 2.0 * B;
+       * @param expr: Elementwise expression, product or product plus elementwise expression.
+       */
+      template<typename Expr>
+      Matrix(const MatrixExpr<Expr>& expr);
+      template<typename LeftScalar, typename RightScalar>
+      Matrix(const ProductExpr<Scalar, LeftScalar, RightScalar>& product);
+      template<typename Addend, typename LeftScalar, typename RightScalar>
+      Matrix(const GemmExpr<Scalar, Addend, LeftScalar, RightScalar>& expr);
+      template<typename First, typename Second>
+      Matrix(const ProductSumExpr<First, Second>& expr);
+
+      /**
+       * Copy assignment operator. Copies into the existing buffer when it has room for other's elements,
+       * and only allocates when it does not.
+       * @param other: Another matrix object to be copied.
+       * @returns: This matrix object after copying data from the provided matrix.
+       */
+      Matrix<Scalar>& operator=(const Matrix<Scalar>& other) {
+         if (this != &other) {
+            reshapeDiscard(other.rows, other.cols);
+            LINEAR_ALGEBRA_INSTRUMENT(Copy, static_cast<std::size_t>(rows) * cols, 0.0, double(rows) * cols * sizeof(Scalar));
+            std::copy(other.matrix_data, other.matrix_data + static_cast<std::size_t>(rows) * cols, matrix_data);
+         }
+         return *this;
+      }
+
+      /**
+       * Move assignment operator for efficient matrix assignment. O(1): the current buffer is released and
+       * other's buffer is taken over.
+       * @param other: Another matrix object, left as an empty 0 x 0 matrix without a buffer.
+       * @returns: This matrix object after moving data from the provided matrix.
+       */
+      Matrix<Scalar>& operator=(Matrix<Scalar>&& other) noexcept {
+         if (this != &other) {
+            detail::releaseStorage(matrix_data);
+            matrix_data = other.matrix_data;
+            rows = other.rows;
+            cols = other.cols;
+            storage_capacity = other.storage_capacity;
+            other.matrix_data = nullptr;
+            other.rows = 0;
+            other.cols = 0;
+            other.storage_capacity = 0;
+         }
+         return *this;
+      }
+
+      /**
+       * Assignment from a matrix expression. The expression is evaluated directly into this matrix's buffer when it
+       * has room for the result and no product operand shares it, so "C = A + B" or "C = A * B + C" allocates nothing.
+       * @param expr: Elementwise expression, product or product plus elementwise expression.
+       * @returns: This matrix object holding the result.
+       */
+      template<typename Expr>
+      Matrix<Scalar>& operator=(const MatrixExpr<Expr>& expr);
+      template<typename LeftScalar, typename RightScalar>
+      Matrix<Scalar>& operator=(const ProductExpr<Scalar, LeftScalar, RightScalar>& product);
+      template<typename Addend, typename LeftScalar, typename RightScalar>
+      Matrix<Scalar>& operator=(const GemmExpr<Scalar, Addend, LeftScalar, RightScalar>& expr);
+      template<typename First, typename Second>
+      Matrix<Scalar>& operator=(const ProductSumExpr<First, Second>& expr);
+
+      /**
+       * In-place accumulation, "C += A * B" runs as a GEMM that accumulates into C.
+       * @param expr: Conformant elementwise expression or product.
+       * @throws An invalid_argument exception if the shapes differ.
+       * @returns: This matrix object.
+       */
+      template<typename Expr>
+      Matrix<Scalar>& operator+=(const MatrixExpr<Expr>& expr);
+      template<typename Expr>
+      Matrix<Scalar>& operator-=(const MatrixExpr<Expr>& expr);
+      template<typename LeftScalar, typename RightScalar>
+      Matrix<Scalar>& operator+=(const ProductExpr<Scalar, LeftScalar, RightScalar>& product);
+      template<typename LeftScalar, typename RightScalar>
+      Matrix<Scalar>& operator-=(const ProductExpr<Scalar, LeftScalar, RightScalar>& product);
+
+      // Destructor
+      ~Matrix(){ detail::releaseStorage(matrix_data); }
+
+      /**
+       * GETTER
+       * Get the number of rows in the matrix.
+       * @returns: Number of rows in the matrix.
+       */
+      int getRows() const { return rows; }
+
+      /**
+       * GETTER
+       * Get the number of columns in the matrix.
+       * @returns: Number of columns in the matrix.
+       */
+      int getCols() const { return cols; }
+
+      /**
+       * Element at a flat (row-major) index, without bounds checks. Used when evaluating expressions.
+       * @param index: row * getCols() + col.
+       * @returns: Value at that position.
+       */
+      Scalar coeff(std::size_t index) const { return matrix_data[index]; }
+
+      /**
+       * Non-owning view of the whole matrix, e.g. A.view().transposed() or A.view().block(0, 0, 2, 2).
+       * The view is invalidated by anything that reallocates this matrix.
+       * @returns: A MatrixView over matrix_data.
+       */
+      MatrixView<Scalar> view() { return MatrixView<Scalar>(matrix_data, rows, cols); }
+      MatrixView<const Scalar> view() const { return MatrixView<const Scalar>(matrix_data, rows, cols); }
+
+      /**
+       * GETTER
+       * Get the number of elements the matrix can hold without reallocating.
+       * @returns: Capacity in elements, at least getRows() * getCols().
+       */
+      std::size_t getCapacity() const { return storage_capacity; }
+
+      /**
+       * Makes room for at least "count" elements, keeping the current contents. Does nothing if the capacity
+       * already suffices.
+       * @param count: Number of elements to reserve.
+       */
+      void reserve(std::size_t count) {
+         if (count <= storage_capacity) {
+            return;
+         }
+         Scalar* new_data = detail::allocateStorage<Scalar>(count);
+         LINEAR_ALGEBRA_INSTRUMENT(Copy, static_cast<std::size_t>(rows) * cols, 0.0, double(rows) * cols * sizeof(Scalar));
+         std::copy(matrix_data, matrix_data + static_cast<std::size_t>(rows) * cols, new_data);
+         detail::releaseStorage(matrix_data);
+         matrix_data = new_data;
+         storage_capacity = count;
+      }
+
+      /**
+       * Changes the dimensions of the matrix. Reallocates only if new_rows * new_cols exceeds getCapacity(); the
+       * flattened contents are kept in that case, i.e. element values are not rearranged to the new shape, and any
+       * elements beyond the old size are uninitialized.
+       * @param new_rows: New number of rows.
+       * @param new_cols: New number of columns.
+       * @throws An invalid_argument exception if a dimension is negative.
+       */
+      void resize(int new_rows, int new_cols) {
+         std::size_t count = detail::elementCount(new_rows, new_cols);
+         if (count > storage_capacity) {
+            Scalar* new_data = detail::allocateStorage<Scalar>(count);
+            LINEAR_ALGEBRA_INSTRUMENT(Copy, static_cast<std::size_t>(rows) * cols, 0.0, double(rows) * cols * sizeof(Scalar));
+            std::copy(matrix_data, matrix_data + static_cast<std::size_t>(rows) * cols, new_data);
+            detail::releaseStorage(matrix_data);
+            matrix_data = new_data;
+            storage_capacity = count;
+         }
+         rows = new_rows;
+         cols = new_cols;
+      }
+
+      /**
+       * GETTER
+       * Get the value of a specific cell in the matrix.
+       * @param row: Row index of the cell.
+       * @param col: Column index of the cell.
+       * @throws An out_of_range exception if the input indexes are out of bounds.
+       * @returns: Value at the specified cell in the matrix.
+       */
+      Scalar get(int row, int col) const {
+         if (row < 0 || row >= rows || col < 0 || col >= cols) {
+            throw std::out_of_range("Specified index is out of bounds");
+         }
+         return matrix_data[row * cols + col];
+      }
+
+      /**
+       * SETTER
+       * Set the value of a specific cell in the matrix.
+       * @param row: Row index of the cell.
+       * @param col: Column index of the cell.
+       * @param value: Value to set in the specified cell.
+       * @throws An out_of_range exception if the input indexes are out of bounds.
+       * @returns: Void. Updates the matrix cell with the provided value.
+       */
+      template<typename ValueType>
+      void set(int row, int col, ValueType value) {
+         static_assert(std::is_same<Scalar, ValueType>::value, "Provided value is of a different type than the matrix's Scalar type.");
+
+         if (row < 0 || row >= rows || col < 0 || col >= cols) {
+            throw std::out_of_range("Specified index is out of bounds");
+         }
+
+         matrix_data[row * cols + col] = value;
+      }
+
+      /**
+       * Element access for hot loops: returns the element by reference without any bounds check in release builds
+       * (see LINEAR_ALGEBRA_CHECK_BOUNDS), so loops over it can be vectorized. Use at() for an always checked access.
+       * @param row: Row index of the cell.
+       * @param col: Column index of the cell.
+       * @returns: Reference to the element.
+       */
+      Scalar& operator()(int row, int col) {
+         detail::debugCheckIndex(row, rows);
+         detail::debugCheckIndex(col, cols);
+         return matrix_data[row * cols + col];
+      }
+
+      const Scalar& operator()(int row, int col) const {
+         detail::debugCheckIndex(row, rows);
+         detail::debugCheckIndex(col, cols);
+         return matrix_data[row * cols + col];
+      }
+
+      /**
+       * Bounds checked element access by reference.
+       * @param row: Row index of the cell.
+       * @param col: Column index of the cell.
+       * @throws An out_of_range exception if the input indexes are out of bounds.
+       * @returns: Reference to the element.
+       */
+      Scalar& at(int row, int col) {
+         if (row < 0 || row >= rows || col < 0 || col >= cols) {
+            throw std::out_of_range("Specified index is out of bounds");
+         }
+         return matrix_data[row * cols + col];
+      }
+
+      const Scalar& at(int row, int col) const {
+         if (row < 0 || row >= rows || col < 0 || col >= cols) {
+            throw std::out_of_range("Specified index is out of bounds");
+         }
+         return matrix_data[row * cols + col];
+      }
+
+      /**
+       * Raw access to the flattened row-major storage, getRows() * getCols() elements, 64-byte aligned. Invalidated
+       * by anything that reallocates the matrix.
+       * @returns: Pointer to element (0, 0).
+       */
+      Scalar* data() { return matrix_data; }
+      const Scalar* data() const { return matrix_data; }
+
+      // The elements in row-major order, e.g. std::fill(A.begin(), A.end(), 0.0).
+      Scalar* begin() { return matrix_data; }
+      Scalar* end() { return matrix_data + static_cast<std::size_t>(rows) * cols; }
+      const Scalar* begin() const { return matrix_data; }
+      const Scalar* end() const { return matrix_data + static_cast<std::size_t>(rows) * cols; }
+
+      /**
+       * One row as a contiguous span; row(i).data() is the row pointer.
+       * @param index: Row index, checked only in debug builds.
+       * @returns: Span over the getCols() elements of the row.
+       */
+      Span<Scalar> row(int index) {
+         detail::debugCheckIndex(index, rows);
+         return Span<Scalar>(matrix_data + static_cast<std::size_t>(index) * cols, cols);
+      }
+
+      Span<const Scalar> row(int index) const {
+         detail::debugCheckIndex(index, rows);
+         return Span<const Scalar>(matrix_data + static_cast<std::size_t>(index) * cols, cols);
+      }
+
+      /**
+       * One column as a strided span, whose random access iterators work with standard algorithms.
+       * @param index: Column index, checked only in debug builds.
+       * @returns: Span over the getRows() elements of the column, getCols() apart.
+       */
+      StridedSpan<Scalar> col(int index) {
+         detail::debugCheckIndex(index, cols);
+         return StridedSpan<Scalar>(matrix_data + index, rows, cols);
+      }
+
+      StridedSpan<const Scalar> col(int index) const {
+         detail::debugCheckIndex(index, cols);
+         return StridedSpan<const Scalar>(matrix_data + index, rows, cols);
+      }
+
+      /**
+       * Overloaded insertion operator for streaming out the matrix content.
+       * Allows for easy printing of the matrix using standard output streams.
+       * @param os: The output stream to write to.
+       * @param matrix: The matrix object to be printed.
+       * @returns: The output stream after inserting the matrix content.
+       */
+      friend std::ostream& operator<< (std::ostream& os, const Matrix<Scalar>& matrix) {
+         detail::writeText(os, matrix.view());
+         return os;
+      }
+
+      /**
+       * Writes the matrix to a binary file (see detail::BinaryHeader) that load() and mmap() open again.
+       * @param path: File to create or overwrite.
+       * @throws A runtime_error exception if the file cannot be written.
+       */
+      void save(const std::string& path) const {
+         detail::writeBinary(path, view());
+      }
+
+      /**
+       * Reads a binary matrix file written by save() into a new matrix.
+       * @param path: File to read.
+       * @throws A runtime_error exception if the file cannot be read, and an invalid_argument exception if it is not
+       *    a matrix file of this Scalar type.
+       * @returns: The loaded matrix.
+       */
+      static Matrix<Scalar> load(const std::string& path);
+
+      /**
+       * Opens a binary matrix file written by save() read-only without parsing or copying it.
+       * @param path: File to map.
+       * @throws The same exceptions as load().
+       * @returns: The mapped matrix, which can be used in expressions like any other matrix.
+       */
+      static MappedMatrix<Scalar> mmap(const std::string& path) {
+         return MappedMatrix<Scalar>(path);
+      }
+
+      /**
+       * Transposes the current matrix in place, without allocating a second buffer.
+       * Square matrices exchange mirrored tiles across the diagonal (see detail::transposeSquareParallel), rectangular
+       * ones are permuted by cycle-following (see detail::transposeCycles), which needs one bit of bookkeeping per element.
+       * transposeInto() is faster for rectangular matrices when there is room for a second buffer.
+       * @returns: Void. The matrix object is transposed with rows and cols swapped.
+       */
+      void transpose() {
+         LINEAR_ALGEBRA_INSTRUMENT(Transpose, std::max(rows, cols), 0.0, 2.0 * rows * cols * sizeof(Scalar));
+         if (rows == cols) {
+            detail::transposeSquareParallel(rows, matrix_data, cols);
+         } else {
+            detail::transposeCycles(rows, cols, matrix_data);
+         }
+         std::swap(rows, cols); // Swap the rows and columns values
+      }
+
+      /**
+       * Writes the transpose of this matrix into another matrix, leaving this one unchanged. The destination's buffer
+       * is reused when it already holds rows * cols elements.
+       * @param dst: Matrix receiving the cols x rows transpose. May be this matrix, which is then transposed in place.
+       */
+      void transposeInto(Matrix<Scalar>& dst) const {
+         if (&dst == this) {
+            dst.transpose();
+            return;
+         }
+         dst.reshapeDiscard(cols, rows);
+         detail::transposeParallel(rows, cols, matrix_data, cols, dst.matrix_data, rows);
+      }
+
+      /**
+       * Writes the transpose of this matrix into a caller-provided buffer.
+       * @param dst: Row-major buffer for the cols x rows transpose, must not overlap this matrix.
+       * @param ldd: Row stride of dst, at least getRows().
+       */
+      void transposeInto(Scalar* dst, std::ptrdiff_t ldd) const {
+         detail::transposeParallel(rows, cols, matrix_data, cols, dst, ldd);
+      }
+};
+
+// Elementwise operations used by BinaryExpr.
+struct AddOp {
+   template<typename Scalar>
+   static constexpr Scalar apply(Scalar left, Scalar right) { return left + right; }
+};
+
+struct SubtractOp {
+   template<typename Scalar>
+   static constexpr Scalar apply(Scalar left, Scalar right) { return left - right; }
+};
+
+struct HadamardOp {
+   template<typename Scalar>
+   static constexpr Scalar apply(Scalar left, Scalar right) { return left * right; }
+};
+
+/**
+ * Lazy elementwise combination of two expressions of the same shape.
+*/
+template<typename Op, typename Left, typename Right>
+class BinaryExpr : public MatrixExpr<BinaryExpr<Op, Left, Right>>
+{
+   private:
+      typename detail::ExprStorage<Left>::type left;
+      typename detail::ExprStorage<Right>::type right;
+
+   public:
+      typedef typename Left::scalar_type scalar_type;
+
+      BinaryExpr(const Left& input_left, const Right& input_right) : left(input_left), right(input_right) {
+         static_assert(std::is_same<scalar_type, typename Right::scalar_type>::value,
+                       "Second matrix is of a different type than the first matrix's type.");
+         if (left.getRows() != right.getRows() || left.getCols() != right.getCols()) {
+            throw std::invalid_argument("Matrices are not conformant for elementwise operation");
+         }
+      }
+
+      int getRows() const { return left.getRows(); }
+      int getCols() const { return left.getCols(); }
+      scalar_type coeff(std::size_t index) const { return Op::apply(left.coeff(index), right.coeff(index)); }
+      const Left& lhs() const { return left; }
+      const Right& rhs() const { return right; }
+};
+
+/**
+ * Lazy alpha * expression.
+*/
+template<typename Expr>
+class ScaledExpr : public MatrixExpr<ScaledExpr<Expr>>
+{
+   private:
+      typename Expr::scalar_type alpha;
+      typename detail::ExprStorage<Expr>::type expr;
+
+   public:
+      typedef typename Expr::scalar_type scalar_type;
+
+      ScaledExpr(scalar_type input_alpha, const Expr& input_expr) : alpha(input_alpha), expr(input_expr) {}
+
+      int getRows() const { return expr.getRows(); }
+      int getCols() const { return expr.getCols(); }
+      scalar_type coeff(std::size_t index) const { return alpha * expr.coeff(index); }
+      scalar_type getAlpha() const { return alpha; }
+      const Expr& expression() const { return expr; }
+};
+
+namespace detail {
+
+// Compile-time list of indices 0 .. N - 1, used to expand fixed-size operations into one initializer per element.
+template<int... Indices>
+struct IndexSequence {
+   typedef IndexSequence type;
+};
+
+template<typename First, typename Second>
+struct ConcatIndices;
+
+template<int... First, int... Second>
+struct ConcatIndices<IndexSequence<First...>, IndexSequence<Second...>> {
+   typedef IndexSequence<First..., (static_cast<int>(sizeof...(First)) + Second)...> type;
+};
+
+template<int N>
+struct MakeIndexSequence
+   : ConcatIndices<typename MakeIndexSequence<N / 2>::type, typename MakeIndexSequence<N - N / 2>::type> {};
+
+template<>
+struct MakeIndexSequence<0> {
+   typedef IndexSequence<> type;
+};
+
+template<>
+struct MakeIndexSequence<1> {
+   typedef IndexSequence<0> type;
+};
+
+// Selects the constructor of FixedMatrix that takes every element in row-major order.
+struct ElementsTag {};
+
+}  // End of namespace detail
+
+/**
+ * Matrix whose dimensions are known at compile time, for small hot-path matrices such as 3x3 rotations or 4x4
+ * transforms.
+ *
+ * The elements live inside the object, so a FixedMatrix never touches the heap and can be kept on the stack, in a
+ * std::vector or in another struct without any indirection. Products, sums and transposes are expanded at compile
+ * time into straight-line code (one multiply-add per term, no loops or bounds checks) and are constexpr, so they
+ * can also be evaluated by the compiler. A FixedMatrix is a MatrixExpr, so it can be assigned to a Matrix or mixed
+ * with Matrix operands in expressions; a Matrix, view or expression of the right shape converts back explicitly.
+ * Meant for small dimensions: the generated code grows with Rows * Cols * inner dimension.
+*/
+template<typename Scalar, int Rows, int Cols>
+class FixedMatrix : public MatrixExpr<FixedMatrix<Scalar, Rows, Cols>>
+{
+   static_assert(Rows > 0 && Cols > 0, "FixedMatrix dimensions must be positive.");
+
+   template<typename OtherScalar, int OtherRows, int OtherCols> friend class FixedMatrix;
+
+   private:
+
+      Scalar fixed_data[Rows * Cols]; // Flattened matrix data in row-major order.
+
+      template<typename... Values>
+      constexpr FixedMatrix(detail::ElementsTag, Values... values) : fixed_data{values...} {}
+
+      template<int... Indices>
+      constexpr FixedMatrix<Scalar, Cols, Rows> transposed(detail::IndexSequence<Indices...>) const {
+         return FixedMatrix<Scalar, Cols, Rows>(detail::ElementsTag(),
+                                                fixed_data[(Indices % Rows) * Cols + Indices / Rows]...);
+      }
+
+      template<typename Op, int... Indices>
+      constexpr FixedMatrix elementwise(const FixedMatrix& other, detail::IndexSequence<Indices...>) const {
+         return FixedMatrix(detail::ElementsTag(), Op::apply(fixed_data[Indices], other.fixed_data[Indices])...);
+      }
+
+      template<int... Indices>
+      constexpr FixedMatrix scaled(Scalar alpha, detail::IndexSequence<Indices...>) const {
+         return FixedMatrix(detail::ElementsTag(), alpha * fixed_data[Indices]...);
+      }
+
+      // Dot product of row "row" of left with column "col" of right over the first K terms.
+      template<int K, int OtherCols>
+      static constexpr Scalar dot(const FixedMatrix& left, const FixedMatrix<Scalar, Cols, OtherCols>& right,
+                                  int row, int col, std::integral_constant<int, K>) {
+         return dot(left, right, row, col, std::integral_constant<int, K - 1>()) +
+                left.fixed_data[row * Cols + K - 1] * right.fixed_data[(K - 1) * OtherCols + col];
+      }
+
+      template<int OtherCols>
+      static constexpr Scalar dot(const FixedMatrix& left, const FixedMatrix<Scalar, Cols, OtherCols>& right,
+                                  int row, int col, std::integral_constant<int, 1>) {
+         return left.fixed_data[row * Cols] * right.fixed_data[col];
+      }
+
+      template<int OtherCols, int... Indices>
+      constexpr FixedMatrix<Scalar, Rows, OtherCols> multiply(const FixedMatrix<Scalar, Cols, OtherCols>& right,
+                                                              detail::IndexSequence<Indices...>) const {
+         return FixedMatrix<Scalar, Rows, OtherCols>(detail::ElementsTag(),
+            dot(*this, right, Indices / OtherCols, Indices % OtherCols, std::integral_constant<int, Cols>())...);
+      }
+
+   public:
+      typedef Scalar scalar_type;
+
+      /**
+       * Constructor: Zero-initialized matrix.
+       */
+      constexpr FixedMatrix() : fixed_data{} {}
+
+      /**
+       * Constructor: Matrix from all of its elements in row-major order, usable in constant expressions,
+       * e.g. FixedMatrix<double, 2, 2> rotation(c, -s, s, c).
+       * @param first: Element (0, 0).
+       * @param rest: The remaining Rows * Cols - 1 elements.
+       */
+      template<typename... Values>
+      constexpr explicit FixedMatrix(Scalar first, Values... rest) : fixed_data{first, static_cast<Scalar>(rest)...} {
+         static_assert(sizeof...(Values) + 1 == Rows * Cols, "Number of elements does not match the matrix size.");
+      }
+
+      /**
+       * Constructor: Matrix from a nested initializer list, like the list constructor of Matrix.
+       * @param init_list: Nested list of rows.
+       * @throws An invalid_argument exception if the list does not have exactly Rows rows of Cols elements.
+       */
+      FixedMatrix(std::initializer_list<std::initializer_list<Scalar>> init_list) : fixed_data{} {
+         if (init_list.size() != static_cast<std::size_t>(Rows)) {
+            throw std::invalid_argument("Number of rows does not match the matrix size");
+         }
+         int i = 0;
+         for (const auto& row : init_list) {
+            if (row.size() != static_cast<std::size_t>(Cols)) {
+               throw std::invalid_argument("Incorrect number of elements in data row");
+            }
+            std::copy(row.begin(), row.end(), fixed_data + i * Cols);
+            ++i;
+         }
+      }
+
+      /**
+       * Constructor: Copies a dynamically sized Matrix, view or expression of the same shape.
+       * @param expr: Source with Rows rows and Cols columns.
+       * @throws An invalid_argument exception if the shapes differ.
+       */
+      template<typename Expr>
+      explicit FixedMatrix(const MatrixExpr<Expr>& expr) : fixed_data{} {
+         static_assert(std::is_same<Scalar, typename Expr::scalar_type>::value,
+                       "Expression is of a different type than the matrix's Scalar type.");
+         const Expr& derived = expr.derived();
+         if (derived.getRows() != Rows || derived.getCols() != Cols) {
+            throw std::invalid_argument("Matrix dimensions do not match the fixed size");
+         }
+         for (int i = 0; i < Rows * Cols; ++i) {
+            fixed_data[i] = derived.coeff(i);
+         }
+      }
+
+      /**
+       * Identity matrix.
+       * @returns: Matrix with ones on the diagonal and zeros elsewhere.
+       */
+      static FixedMatrix identity() {
+         static_assert(Rows == Cols, "Identity matrix must be square.");
+         FixedMatrix result;
+         for (int i = 0; i < Rows; ++i) {
+            result.fixed_data[i * Cols + i] = Scalar(1);
+         }
+         return result;
+      }
+
+      static constexpr int getRows() { return Rows; }
+      static constexpr int getCols() { return Cols; }
+
+      // Element at a flat row-major index. Used when evaluating expressions.
+      constexpr Scalar coeff(std::size_t index) const { return fixed_data[index]; }
+
+      // Element at (row, col) without bounds checking, usable in constant expressions.
+      constexpr Scalar coeff(int row, int col) const { return fixed_data[row * Cols + col]; }
+
+      /**
+       * GETTER
+       * Get the value of a specific cell in the matrix.
+       * @param row: Row index of the cell.
+       * @param col: Column index of the cell.
+       * @throws An out_of_range exception if the input indexes are out of bounds.
+       * @returns: Value at the specified cell in the matrix.
+       */
+      Scalar get(int row, int col) const {
+         if (row < 0 || row >= Rows || col < 0 || col >= Cols) {
+            throw std::out_of_range("Specified index is out of bounds");
+         }
+         return fixed_data[row * Cols + col];
+      }
+
+      /**
+       * SETTER
+       * Set the value of a specific cell in the matrix.
+       * @param row: Row index of the cell.
+       * @param col: Column index of the cell.
+       * @param value: Value to set in the specified cell.
+       * @throws An out_of_range exception if the input indexes are out of bounds.
+       */
+      template<typename ValueType>
+      void set(int row, int col, ValueType value) {
+         static_assert(std::is_same<Scalar, ValueType>::value, "Provided value is of a different type than the matrix's Scalar type.");
+
+         if (row < 0 || row >= Rows || col < 0 || col >= Cols) {
+            throw std::out_of_range("Specified index is out of bounds");
+         }
+
+         fixed_data[row * Cols + col] = value;
+      }
+
+      // Element access by reference, checked only in debug builds like Matrix::operator().
+      Scalar& operator()(int row, int col) {
+         detail::debugCheckIndex(row, Rows);
+         detail::debugCheckIndex(col, Cols);
+         return fixed_data[row * Cols + col];
+      }
+
+      const Scalar& operator()(int row, int col) const {
+         detail::debugCheckIndex(row, Rows);
+         detail::debugCheckIndex(col, Cols);
+         return fixed_data[row * Cols + col];
+      }
+
+      // Bounds checked element access by reference, throws out_of_range like get().
+      Scalar& at(int row, int col) {
+         if (row < 0 || row >= Rows || col < 0 || col >= Cols) {
+            throw std::out_of_range("Specified index is out of bounds");
+         }
+         return fixed_data[row * Cols + col];
+      }
+
+      const Scalar& at(int row, int col) const {
+         if (row < 0 || row >= Rows || col < 0 || col >= Cols) {
+            throw std::out_of_range("Specified index is out of bounds");
+         }
+         return fixed_data[row * Cols + col];
+      }
+
+      // Raw row-major storage and iteration over it, as for Matrix.
+      Scalar* data() { return fixed_data; }
+      const Scalar* data() const { return fixed_data; }
+      Scalar* begin() { return fixed_data; }
+      Scalar* end() { return fixed_data + Rows * Cols; }
+      const Scalar* begin() const { return fixed_data; }
+      const Scalar* end() const { return fixed_data + Rows * Cols; }
+
+      Span<Scalar> row(int index) {
+         detail::debugCheckIndex(index, Rows);
+         return Span<Scalar>(fixed_data + index * Cols, Cols);
+      }
+
+      Span<const Scalar> row(int index) const {
+         detail::debugCheckIndex(index, Rows);
+         return Span<const Scalar>(fixed_data + index * Cols, Cols);
+      }
+
+      StridedSpan<Scalar> col(int index) {
+         detail::debugCheckIndex(index, Cols);
+         return StridedSpan<Scalar>(fixed_data + index, Rows, Cols);
+      }
+
+      StridedSpan<const Scalar> col(int index) const {
+         detail::debugCheckIndex(index, Cols);
+         return StridedSpan<const Scalar>(fixed_data + index, Rows, Cols);
+      }
+
+      /**
+       * Views of the inline storage, e.g. to pass a FixedMatrix to LinearAlgebra::gemm().
+       * @returns: View of all Rows x Cols elements.
+       */
+      MatrixView<Scalar> view() { return MatrixView<Scalar>(fixed_data, Rows, Cols); }
+      MatrixView<const Scalar> view() const { return MatrixView<const Scalar>(fixed_data, Rows, Cols); }
+
+      /**
+       * Transpose into a new fixed-size matrix.
+       * @returns: The Cols x Rows transpose.
+       */
+      constexpr FixedMatrix<Scalar, Cols, Rows> transposed() const {
+         return transposed(typename detail::MakeIndexSequence<Rows * Cols>::type());
+      }
+
+      /**
+       * Transposes a square matrix in place.
+       * @returns: Void. The matrix is replaced by its transpose.
+       */
+      void transpose() {
+         static_assert(Rows == Cols, "Only square fixed-size matrices can be transposed in place, use transposed().");
+         for (int i = 0; i < Rows; ++i) {
+            for (int j = i + 1; j < Cols; ++j) {
+               std::swap(fixed_data[i * Cols + j], fixed_data[j * Cols + i]);
+            }
+         }
+      }
+
+      /**
+       * Multiplication of fixed-size matrices, expanded into one multiply-add per term.
+       * @param left: Rows x Cols matrix.
+       * @param right: Cols x OtherCols matrix.
+       * @returns: The Rows x OtherCols product, computed without any heap allocation.
+       */
+      template<int OtherCols>
+      friend constexpr FixedMatrix<Scalar, Rows, OtherCols> operator*(const FixedMatrix& left,
+                                                                      const FixedMatrix<Scalar, Cols, OtherCols>& right) {
+         return left.multiply(right, typename detail::MakeIndexSequence<Rows * OtherCols>::type());
+      }
+
+      friend constexpr FixedMatrix operator+(const FixedMatrix& left, const FixedMatrix& right) {
+         return left.template elementwise<AddOp>(right, typename detail::MakeIndexSequence<Rows * Cols>::type());
+      }
+
+      friend constexpr FixedMatrix operator-(const FixedMatrix& left, const FixedMatrix& right) {
+         return left.template elementwise<SubtractOp>(right, typename detail::MakeIndexSequence<Rows * Cols>::type());
+      }
+
+      friend constexpr FixedMatrix operator-(const FixedMatrix& matrix) {
+         return matrix.scaled(Scalar(-1), typename detail::MakeIndexSequence<Rows * Cols>::type());
+      }
+
+      friend constexpr FixedMatrix operator*(Scalar alpha, const FixedMatrix& matrix) {
+         return matrix.scaled(alpha, typename detail::MakeIndexSequence<Rows * Cols>::type());
+      }
+
+      friend constexpr FixedMatrix operator*(const FixedMatrix& matrix, Scalar alpha) {
+         return matrix.scaled(alpha, typename detail::MakeIndexSequence<Rows * Cols>::type());
+      }
+
+      friend constexpr FixedMatrix hadamard(const FixedMatrix& left, const FixedMatrix& right) {
+         return left.template elementwise<HadamardOp>(right, typename detail::MakeIndexSequence<Rows * Cols>::type());
+      }
+
+      FixedMatrix& operator+=(const FixedMatrix& other) { return *this = *this + other; }
+      FixedMatrix& operator-=(const FixedMatrix& other) { return *this = *this - other; }
+      FixedMatrix& operator*=(Scalar alpha) { return *this = *this * alpha; }
+
+      /**
+       * Overloaded insertion operator for streaming out the matrix content.
+       * @param os: The output stream to write to.
+       * @param matrix: The matrix object to be printed.
+       * @returns: The output stream after inserting the matrix content.
+       */
+      friend std::ostream& operator<< (std::ostream& os, const FixedMatrix& matrix) {
+         detail::writeText(os, matrix.view());
+         return os;
+      }
+};
+
+namespace detail {
+
+/**
+ * Evaluates an elementwise expression into the flattened buffer dst in a single pass. Each element of dst is
+ * written only after every operand value at the same index has been read, so dst may be one of the operands.
+*/
+template<typename Scalar, typename Expr>
+void assignElementwise(Scalar* dst, const Expr& expr) {
+   std::size_t size = static_cast<std::size_t>(expr.getRows()) * expr.getCols();
+   for (std::size_t i = 0; i < size; ++i) {
+      dst[i] = expr.coeff(i);
+   }
+}
+
+// A single operation on two matrices maps directly onto a SIMD kernel.
+template<typename Scalar>
+void assignElementwise(Scalar* dst, const BinaryExpr<AddOp, Matrix<Scalar>, Matrix<Scalar>>& expr) {
+   kernels<Scalar>().add(static_cast<std::size_t>(expr.getRows()) * expr.getCols(),
+                         MatrixAccess::data(expr.lhs()), MatrixAccess::data(expr.rhs()), dst);
+}
+
+template<typename Scalar>
+void assignElementwise(Scalar* dst, const BinaryExpr<SubtractOp, Matrix<Scalar>, Matrix<Scalar>>& expr) {
+   kernels<Scalar>().subtract(static_cast<std::size_t>(expr.getRows()) * expr.getCols(),
+                              MatrixAccess::data(expr.lhs()), MatrixAccess::data(expr.rhs()), dst);
+}
+
+template<typename Scalar>
+void assignElementwise(Scalar* dst, const BinaryExpr<HadamardOp, Matrix<Scalar>, Matrix<Scalar>>& expr) {
+   kernels<Scalar>().multiply(static_cast<std::size_t>(expr.getRows()) * expr.getCols(),
+                              MatrixAccess::data(expr.lhs()), MatrixAccess::data(expr.rhs()), dst);
+}
+
+template<typename Scalar>
+void assignElementwise(Scalar* dst, const ScaledExpr<Matrix<Scalar>>& expr) {
+   kernels<Scalar>().scale(static_cast<std::size_t>(expr.getRows()) * expr.getCols(),
+                           expr.getAlpha(), MatrixAccess::data(expr.expression()), dst);
+}
+
+// A view is copied row by row, or through the tiled transpose when it is transposed.
+template<typename Scalar, typename ViewScalar>
+void assignElementwise(Scalar* dst, const MatrixView<ViewScalar>& view) {
+   if (view.isTransposed()) {
+      transposeParallel(view.getCols(), view.getRows(), view.data(), view.getStride(), dst, view.getCols());
+      return;
+   }
+   for (int i = 0; i < view.getRows(); ++i) {
+      const Scalar* row = view.data() + i * view.getStride();
+      std::copy(row, row + view.getCols(), dst + static_cast<std::size_t>(i) * view.getCols());
+   }
+}
+
+/**
+ * True if evaluating "expr" elementwise straight into [dst, dst + size) could overwrite an element before it is
+ * read. Matrix operands share the destination's flat layout and are always safe; views are safe only when they
+ * cover the destination with exactly the same layout.
+*/
+template<typename Scalar, typename Expr>
+bool unsafeAlias(const MatrixExpr<Expr>&, const Scalar*, std::size_t) {
+   return false;
+}
+
+template<typename Scalar, typename ViewScalar>
+bool unsafeAlias(const MatrixView<ViewScalar>& view, const Scalar* dst, std::size_t size) {
+   if (!view.isTransposed() && view.data() == dst && view.getStride() == view.getCols()) {
+      return false;
+   }
+   return view.overlaps(dst, size);
+}
+
+template<typename Scalar, typename Op, typename Left, typename Right>
+bool unsafeAlias(const BinaryExpr<Op, Left, Right>& expr, const Scalar* dst, std::size_t size) {
+   return unsafeAlias(expr.lhs(), dst, size) || unsafeAlias(expr.rhs(), dst, size);
+}
+
+template<typename Scalar, typename Expr>
+bool unsafeAlias(const ScaledExpr<Expr>& expr, const Scalar* dst, std::size_t size) {
+   return unsafeAlias(expr.expression(), dst, size);
+}
+
+// dst += sign * expr, with the same aliasing guarantee as assignElementwise().
+template<typename Scalar, typename Expr>
+void accumulateElementwise(Scalar* dst, const Expr& expr, Scalar sign) {
+   std::size_t size = static_cast<std::size_t>(expr.getRows()) * expr.getCols();
+   for (std::size_t i = 0; i < size; ++i) {
+      dst[i] += sign * expr.coeff(i);
+   }
+}
+
+template<typename Scalar>
+void accumulateElementwise(Scalar* dst, const Matrix<Scalar>& matrix, Scalar sign) {
+   kernels<Scalar>().axpy(static_cast<std::size_t>(matrix.getRows()) * matrix.getCols(),
+                          sign, MatrixAccess::data(matrix), dst);
+}
+
+template<typename Scalar>
+void accumulateElementwise(Scalar* dst, const ScaledExpr<Matrix<Scalar>>& expr, Scalar sign) {
+   kernels<Scalar>().axpy(static_cast<std::size_t>(expr.getRows()) * expr.getCols(),
+                          sign * expr.getAlpha(), MatrixAccess::data(expr.expression()), dst);
+}
+
+/**
+ * Turns one side of a product into a read-only view. Matrices and views are used in place and a scaled matrix
+ * folds its factor into alpha, which has the product's Scalar type; any other expression is evaluated once into
+ * "storage". Operands keep their own element type, mixed-type products convert them only while packing.
+*/
+template<typename Scalar, typename Alpha>
+MatrixView<const Scalar> makeOperand(const Matrix<Scalar>& matrix, std::vector<Scalar>&, Alpha&) {
+   return matrix.view();
+}
+
+template<typename ViewScalar, typename Scalar, typename Alpha>
+MatrixView<const Scalar> makeOperand(const MatrixView<ViewScalar>& view, std::vector<Scalar>&, Alpha&) {
+   return view;
+}
+
+template<typename Scalar, int Rows, int Cols, typename Alpha>
+MatrixView<const Scalar> makeOperand(const FixedMatrix<Scalar, Rows, Cols>& matrix, std::vector<Scalar>&, Alpha&) {
+   return matrix.view();
+}
+
+template<typename Scalar, typename Alpha>
+MatrixView<const Scalar> makeOperand(const MappedMatrix<Scalar>& matrix, std::vector<Scalar>&, Alpha&) {
+   return matrix.view();
+}
+
+template<typename Scalar, typename Alpha>
+MatrixView<const Scalar> makeOperand(const ScaledExpr<Matrix<Scalar>>& expr, std::vector<Scalar>& storage, Alpha& alpha) {
+   alpha *= static_cast<Alpha>(expr.getAlpha());
+   return makeOperand(expr.expression(), storage, alpha);
+}
+
+template<typename Scalar, typename Expr, typename Alpha>
+MatrixView<const Scalar> makeOperand(const MatrixExpr<Expr>& expr, std::vector<Scalar>& storage, Alpha&) {
+   const Expr& derived = expr.derived();
+   storage.resize(static_cast<std::size_t>(derived.getRows()) * derived.getCols());
+   assignElementwise(storage.data(), derived);
+   return MatrixView<const Scalar>(storage.data(), derived.getRows(), derived.getCols());
+}
+
+template<typename Scalar, typename LeftScalar, typename RightScalar, typename Alpha>
+MatrixView<const Scalar> makeOperand(const ProductExpr<Scalar, LeftScalar, RightScalar>& product,
+                                     std::vector<Scalar>& storage, Alpha&) {
+   storage.resize(static_cast<std::size_t>(product.getRows()) * product.getCols());
+   product.evaluateInto(Scalar(0), storage.data());
+   return MatrixView<const Scalar>(storage.data(), product.getRows(), product.getCols());
+}
+
+// Type of the product node of operands with element types LeftScalar and RightScalar.
+template<typename LeftScalar, typename RightScalar>
+struct ProductOf {
+   typedef ProductExpr<typename ProductScalar<LeftScalar, RightScalar>::type, LeftScalar, RightScalar> type;
+};
+
+template<typename LeftScalar, typename RightScalar, typename Left, typename Right>
+typename ProductOf<LeftScalar, RightScalar>::type makeProduct(const Left& left, const Right& right) {
+   typedef typename ProductScalar<LeftScalar, RightScalar>::type Scalar;
+   Scalar alpha(1);
+   std::vector<LeftScalar> left_storage;
+   std::vector<RightScalar> right_storage;
+   MatrixView<const LeftScalar> left_operand = makeOperand(left, left_storage, alpha);
+   MatrixView<const RightScalar> right_operand = makeOperand(right, right_storage, alpha);
+   // Check if matrices are conformant.
+   if (left_operand.getCols() != right_operand.getRows()) {
+      throw std::invalid_argument("Matrices are not conformant for multiplication");
+   }
+   return typename ProductOf<LeftScalar, RightScalar>::type(left_operand, right_operand, alpha,
+                                                            std::move(left_storage), std::move(right_storage));
+}
+
+/**
+ * If the addend of a GemmExpr is the destination itself (optionally scaled), folds its factor into beta and
+ * returns true, so the GEMM can scale and accumulate in place instead of copying the addend first.
+*/
+template<typename Scalar, typename Addend>
+bool addendIsDestination(const Addend&, const Scalar*, Scalar&) {
+   return false;
+}
+
+template<typename Scalar>
+bool addendIsDestination(const Matrix<Scalar>& addend, const Scalar* dst, Scalar&) {
+   return MatrixAccess::data(addend) == dst;
+}
+
+template<typename Scalar>
+bool addendIsDestination(const ScaledExpr<Matrix<Scalar>>& addend, const Scalar* dst, Scalar& beta) {
+   if (MatrixAccess::data(addend.expression()) != dst) {
+      return false;
+   }
+   beta *= addend.getAlpha();
+   return true;
+}
+
+// Evaluates a GemmExpr into dst, which must not alias the product operands.
+template<typename Scalar, typename Addend, typename LeftScalar, typename RightScalar>
+void evaluateGemm(const GemmExpr<Scalar, Addend, LeftScalar, RightScalar>& expr, Scalar* dst) {
+   Scalar beta = expr.getBeta();
+   if (!addendIsDestination(expr.addend(), dst, beta)) {
+      assignElementwise(dst, ScaledExpr<Addend>(beta, expr.addend()));
+      beta = Scalar(1);
+   }
+   expr.product().evaluateInto(beta, dst);
+}
+
+}  // End of namespace detail
+
+/**
+ * Elementwise sum of two conformant matrix expressions.
+ * @throws An invalid_argument exception if the shapes differ.
+*/
+template<typename Left, typename Right>
+BinaryExpr<AddOp, Left, Right> operator+(const MatrixExpr<Left>& left, const MatrixExpr<Right>& right) {
+   return BinaryExpr<AddOp, Left, Right>(left.derived(), right.derived());
+}
+
+/**
+ * Elementwise difference of two conformant matrix expressions.
+ * @throws An invalid_argument exception if the shapes differ.
+*/
+template<typename Left, typename Right>
+BinaryExpr<SubtractOp, Left, Right> operator-(const MatrixExpr<Left>& left, const MatrixExpr<Right>& right) {
+   return BinaryExpr<SubtractOp, Left, Right>(left.derived(), right.derived());
+}
+
+/**
+ * Hadamard (elementwise) product of two conformant matrix expressions.
+ * @throws An invalid_argument exception if the shapes differ.
+*/
+template<typename Left, typename Right>
+BinaryExpr<HadamardOp, Left, Right> hadamard(const MatrixExpr<Left>& left, const MatrixExpr<Right>& right) {
+   return BinaryExpr<HadamardOp, Left, Right>(left.derived(), right.derived());
+}
+
+// Scaling of a matrix expression by a scalar of its own Scalar type.
+template<typename Expr>
+ScaledExpr<Expr> operator*(typename Expr::scalar_type alpha, const MatrixExpr<Expr>& expr) {
+   return ScaledExpr<Expr>(alpha, expr.derived());
+}
+
+template<typename Expr>
+ScaledExpr<Expr> operator*(const MatrixExpr<Expr>& expr, typename Expr::scalar_type alpha) {
+   return ScaledExpr<Expr>(alpha, expr.derived());
+}
+
+template<typename Expr>
+ScaledExpr<Expr> operator-(const MatrixExpr<Expr>& expr) {
+   return ScaledExpr<Expr>(typename Expr::scalar_type(-1), expr.derived());
+}
+
+/**
+ * Overloaded multiplication operator for matrix multiplication.
+ * Builds a lazy product of two conformant matrix expressions; it is computed by the packed GEMM kernel
+ * (see detail::gemmParallel) once it is assigned to a Matrix.
+ * Note: The matrices may have different Scalar types. The product has type ProductScalar<Left, Right>, e.g.
+ * Matrix<int> for two Matrix<int8_t> and Matrix<double> for Matrix<int> times Matrix<double>, and is accumulated in
+ * that type; the operands are converted while they are packed, not copied beforehand.
+ * @throws An invalid_argument exception if the matrices are not conformant.
+ * @returns: The lazy product.
+*/
+template<typename Left, typename Right>
+typename detail::ProductOf<typename Left::scalar_type, typename Right::scalar_type>::type
+operator*(const MatrixExpr<Left>& left, const MatrixExpr<Right>& right) {
+   return detail::makeProduct<typename Left::scalar_type, typename Right::scalar_type>(left.derived(), right.derived());
+}
+
+template<typename Scalar, typename LeftScalar, typename RightScalar, typename Right>
+typename detail::ProductOf<Scalar, typename Right::scalar_type>::type
+operator*(const ProductExpr<Scalar, LeftScalar, RightScalar>& left, const MatrixExpr<Right>& right) {
+   return detail::makeProduct<Scalar, typename Right::scalar_type>(left, right.derived());
+}
+
+template<typename Scalar, typename LeftScalar, typename RightScalar, typename Left>
+typename detail::ProductOf<typename Left::scalar_type, Scalar>::type
+operator*(const MatrixExpr<Left>& left, const ProductExpr<Scalar, LeftScalar, RightScalar>& right) {
+   return detail::makeProduct<typename Left::scalar_type, Scalar>(left.derived(), right);
+}
+
+template<typename Scalar, typename LeftScalar, typename RightScalar,
+         typename OtherScalar, typename OtherLeftScalar, typename OtherRightScalar>
+typename detail::ProductOf<Scalar, OtherScalar>::type
+operator*(const ProductExpr<Scalar, LeftScalar, RightScalar>& left,
+          const ProductExpr<OtherScalar, OtherLeftScalar, OtherRightScalar>& right) {
+   return detail::makeProduct<Scalar, OtherScalar>(left, right);
+}
+
+template<typename Scalar, typename LeftScalar, typename RightScalar>
+ProductExpr<Scalar, LeftScalar, RightScalar> operator*(typename detail::Identity<Scalar>::type alpha,
+                                                       ProductExpr<Scalar, LeftScalar, RightScalar>&& product) {
+   return std::move(product).scaled(alpha);
+}
+
+template<typename Scalar, typename LeftScalar, typename RightScalar>
+ProductExpr<Scalar, LeftScalar, RightScalar> operator*(ProductExpr<Scalar, LeftScalar, RightScalar>&& product,
+                                                       typename detail::Identity<Scalar>::type alpha) {
+   return std::move(product).scaled(alpha);
+}
+
+template<typename Scalar, typename LeftScalar, typename RightScalar>
+ProductExpr<Scalar, LeftScalar, RightScalar> operator-(ProductExpr<Scalar, LeftScalar, RightScalar>&& product) {
+   return std::move(product).scaled(Scalar(-1));
+}
+
+/**
+ * General matrix multiply on views: C = alpha * op(A) * op(B) + beta * C, where op() is the transposition recorded
+ * in each view, so transposed operands and blocks of larger matrices are multiplied without copying them.
+ * @param alpha: Scale of the product.
+ * @param a: Left operand.
+ * @param b: Right operand.
+ * @param beta: Scale of the existing contents of c, zero ignores them.
+ * @param c: Destination view, written in place.
+ * @throws An invalid_argument exception if the shapes are not conformant.
+*/
+template<typename Scalar>
+void gemm(typename detail::Identity<Scalar>::type alpha,
+          const typename detail::Identity<MatrixView<const Scalar>>::type& a,
+          const typename detail::Identity<MatrixView<const Scalar>>::type& b,
+          typename detail::Identity<Scalar>::type beta, const MatrixView<Scalar>& c) {
+   if (a.getCols() != b.getRows() || a.getRows() != c.getRows() || b.getCols() != c.getCols()) {
+      throw std::invalid_argument("Matrices are not conformant for multiplication");
+   }
+   if (c.isTransposed()) {
+      // The kernel writes row-major blocks, so compute C^T = op(B)^T * op(A)^T instead.
+      gemm<Scalar>(alpha, b.transposed(), a.transposed(), beta, c.transposed());
+      return;
+   }
+   std::size_t span = c.getRows() == 0 ? 0 : static_cast<std::size_t>(c.getRows() - 1) * c.getStride() + c.getCols();
+   if (a.overlaps(c.data(), span) || b.overlaps(c.data(), span)) {
+      std::vector<Scalar> result(static_cast<std::size_t>(c.getRows()) * c.getCols());
+      detail::gemmParallel(c.getRows(), c.getCols(), a.getCols(), alpha, a.data(), a.rowStep(), a.colStep(),
+                           b.data(), b.rowStep(), b.colStep(), Scalar(0), result.data(), c.getCols());
+      for (int i = 0; i < c.getRows(); ++i) {
+         Scalar* row = c.data() + i * c.getStride();
+         for (int j = 0; j < c.getCols(); ++j) {
+            row[j] = (beta == Scalar(0) ? Scalar(0) : beta * row[j]) + result[i * c.getCols() + j];
+         }
+      }
+      return;
+   }
+   detail::gemmParallel(c.getRows(), c.getCols(), a.getCols(), alpha, a.data(), a.rowStep(), a.colStep(),
+                        b.data(), b.rowStep(), b.colStep(), beta, c.data(), c.getStride());
+}
+
+// A product combined with an elementwise expression becomes a single GEMM with accumulate.
+template<typename Scalar, typename LeftScalar, typename RightScalar, typename Addend>
+GemmExpr<Scalar, Addend, LeftScalar, RightScalar>
+operator+(ProductExpr<Scalar, LeftScalar, RightScalar>&& product, const MatrixExpr<Addend>& addend) {
+   return GemmExpr<Scalar, Addend, LeftScalar, RightScalar>(std::move(product), addend.derived(), Scalar(1));
+}
+
+template<typename Scalar, typename LeftScalar, typename RightScalar, typename Addend>
+GemmExpr<Scalar, Addend, LeftScalar, RightScalar>
+operator+(const MatrixExpr<Addend>& addend, ProductExpr<Scalar, LeftScalar, RightScalar>&& product) {
+   return GemmExpr<Scalar, Addend, LeftScalar, RightScalar>(std::move(product), addend.derived(), Scalar(1));
+}
+
+template<typename Scalar, typename LeftScalar, typename RightScalar, typename Addend>
+GemmExpr<Scalar, Addend, LeftScalar, RightScalar>
+operator-(ProductExpr<Scalar, LeftScalar, RightScalar>&& product, const MatrixExpr<Addend>& addend) {
+   return GemmExpr<Scalar, Addend, LeftScalar, RightScalar>(std::move(product), addend.derived(), Scalar(-1));
+}
+
+template<typename Scalar, typename LeftScalar, typename RightScalar, typename Addend>
+GemmExpr<Scalar, Addend, LeftScalar, RightScalar>
+operator-(const MatrixExpr<Addend>& addend, ProductExpr<Scalar, LeftScalar, RightScalar>&& product) {
+   return GemmExpr<Scalar, Addend, LeftScalar, RightScalar>(std::move(product).scaled(Scalar(-1)), addend.derived(),
+                                                            Scalar(1));
+}
+
+template<typename Scalar, typename Addend, typename LeftScalar, typename RightScalar, typename Other>
+GemmExpr<Scalar, BinaryExpr<AddOp, ScaledExpr<Addend>, Other>, LeftScalar, RightScalar>
+operator+(GemmExpr<Scalar, Addend, LeftScalar, RightScalar>&& gemm, const MatrixExpr<Other>& other) {
+   typedef BinaryExpr<AddOp, ScaledExpr<Addend>, Other> Sum;
+   Sum sum(ScaledExpr<Addend>(gemm.getBeta(), gemm.addend()), other.derived());
+   return GemmExpr<Scalar, Sum, LeftScalar, RightScalar>(std::move(gemm).takeProduct(), sum, Scalar(1));
+}
+
+template<typename Scalar, typename Addend, typename LeftScalar, typename RightScalar, typename Other>
+GemmExpr<Scalar, BinaryExpr<SubtractOp, ScaledExpr<Addend>, Other>, LeftScalar, RightScalar>
+operator-(GemmExpr<Scalar, Addend, LeftScalar, RightScalar>&& gemm, const MatrixExpr<Other>& other) {
+   typedef BinaryExpr<SubtractOp, ScaledExpr<Addend>, Other> Difference;
+   Difference difference(ScaledExpr<Addend>(gemm.getBeta(), gemm.addend()), other.derived());
+   return GemmExpr<Scalar, Difference, LeftScalar, RightScalar>(std::move(gemm).takeProduct(), difference, Scalar(1));
+}
+
+// The sum or difference of two products of the same result type, e.g. A * B + C * D, runs as two accumulating GEMMs.
+template<typename Scalar, typename LeftScalar, typename RightScalar, typename OtherLeftScalar, typename OtherRightScalar>
+ProductSumExpr<ProductExpr<Scalar, LeftScalar, RightScalar>, ProductExpr<Scalar, OtherLeftScalar, OtherRightScalar>>
+operator+(ProductExpr<Scalar, LeftScalar, RightScalar>&& first, ProductExpr<Scalar, OtherLeftScalar, OtherRightScalar>&& second) {
+   return ProductSumExpr<ProductExpr<Scalar, LeftScalar, RightScalar>, ProductExpr<Scalar, OtherLeftScalar, OtherRightScalar>>(
+      std::move(first), std::move(second));
+}
+
+template<typename Scalar, typename LeftScalar, typename RightScalar, typename OtherLeftScalar, typename OtherRightScalar>
+ProductSumExpr<ProductExpr<Scalar, LeftScalar, RightScalar>, ProductExpr<Scalar, OtherLeftScalar, OtherRightScalar>>
+operator-(ProductExpr<Scalar, LeftScalar, RightScalar>&& first, ProductExpr<Scalar, OtherLeftScalar, OtherRightScalar>&& second) {
+   return ProductSumExpr<ProductExpr<Scalar, LeftScalar, RightScalar>, ProductExpr<Scalar, OtherLeftScalar, OtherRightScalar>>(
+      std::move(first), std::move(second).scaled(Scalar(-1)));
+}
+
+// Matrix members that evaluate expressions. Defined here because they need the expression nodes above.
+
+template<typename Scalar>
+template<typename Expr>
+Matrix<Scalar>::Matrix(const MatrixExpr<Expr>& expr)
+   : Matrix(expr.derived().getRows(), expr.derived().getCols()) {
+   static_assert(std::is_same<Scalar, typename Expr::scalar_type>::value,
+                 "Expression is of a different type than the matrix's Scalar type.");
+   LINEAR_ALGEBRA_INSTRUMENT(Elementwise, std::max(rows, cols), 0.0, double(rows) * cols * sizeof(Scalar));
+   detail::assignElementwise(matrix_data, expr.derived());
+}
+
+template<typename Scalar>
+template<typename LeftScalar, typename RightScalar>
+Matrix<Scalar>::Matrix(const ProductExpr<Scalar, LeftScalar, RightScalar>& product)
+   : Matrix(product.getRows(), product.getCols()) {
+   product.evaluateInto(Scalar(0), matrix_data);
+}
+
+template<typename Scalar>
+template<typename Addend, typename LeftScalar, typename RightScalar>
+Matrix<Scalar>::Matrix(const GemmExpr<Scalar, Addend, LeftScalar, RightScalar>& expr)
+   : Matrix(expr.getRows(), expr.getCols()) {
+   detail::evaluateGemm(expr, matrix_data);
+}
+
+template<typename Scalar>
+template<typename First, typename Second>
+Matrix<Scalar>::Matrix(const ProductSumExpr<First, Second>& expr)
+   : Matrix(expr.getRows(), expr.getCols()) {
+   static_assert(std::is_same<Scalar, typename First::scalar_type>::value,
+                 "Expression is of a different type than the matrix's Scalar type.");
+   expr.evaluateInto(matrix_data);
+}
+
+template<typename Scalar>
+template<typename Expr>
+Matrix<Scalar>& Matrix<Scalar>::operator=(const MatrixExpr<Expr>& expr) {
+   static_assert(std::is_same<Scalar, typename Expr::scalar_type>::value,
+                 "Expression is of a different type than the matrix's Scalar type.");
+   const Expr& derived = expr.derived();
+   if (static_cast<std::size_t>(derived.getRows()) * derived.getCols() > storage_capacity ||
+       detail::unsafeAlias(derived, matrix_data, static_cast<std::size_t>(rows) * cols)) {
+      // The old buffer may still be an operand, so evaluate into a fresh one.
+      Matrix<Scalar> result(expr);
+      swapData(result);
+      return *this;
+   }
+   // A Matrix operand that shares this buffer necessarily has this matrix's shape, so evaluating in place is safe.
+   LINEAR_ALGEBRA_INSTRUMENT(Elementwise, std::max(derived.getRows(), derived.getCols()), 0.0,
+                             double(derived.getRows()) * derived.getCols() * sizeof(Scalar));
+   detail::assignElementwise(matrix_data, derived);
+   rows = derived.getRows();
+   cols = derived.getCols();
+   return *this;
+}
+
+template<typename Scalar>
+template<typename LeftScalar, typename RightScalar>
+Matrix<Scalar>& Matrix<Scalar>::operator=(const ProductExpr<Scalar, LeftScalar, RightScalar>& product) {
+   if (product.aliases(matrix_data, static_cast<std::size_t>(rows) * cols)) {
+      Matrix<Scalar> result(product);
+      swapData(result);
+      return *this;
+   }
+   reshapeDiscard(product.getRows(), product.getCols());
+   product.evaluateInto(Scalar(0), matrix_data);
+   return *this;
+}
+
+template<typename Scalar>
+template<typename Addend, typename LeftScalar, typename RightScalar>
+Matrix<Scalar>& Matrix<Scalar>::operator=(const GemmExpr<Scalar, Addend, LeftScalar, RightScalar>& expr) {
+   if (expr.product().aliases(matrix_data, static_cast<std::size_t>(rows) * cols) ||
+       detail::unsafeAlias(expr.addend(), matrix_data, static_cast<std::size_t>(rows) * cols)) {
+      Matrix<Scalar> result(expr);
+      swapData(result);
+      return *this;
+   }
+   // If the addend is this matrix the shapes already match and the buffer is kept.
+   reshapeDiscard(expr.getRows(), expr.getCols());
+   detail::evaluateGemm(expr, matrix_data);
+   return *this;
+}
+
+template<typename Scalar>
+template<typename First, typename Second>
+Matrix<Scalar>& Matrix<Scalar>::operator=(const ProductSumExpr<First, Second>& expr) {
+   static_assert(std::is_same<Scalar, typename First::scalar_type>::value,
+                 "Expression is of a different type than the matrix's Scalar type.");
+   if (expr.aliases(matrix_data, static_cast<std::size_t>(rows) * cols)) {
+      Matrix<Scalar> result(expr);
+      swapData(result);
+      return *this;
+   }
+   reshapeDiscard(expr.getRows(), expr.getCols());
+   expr.evaluateInto(matrix_data);
+   return *this;
+}
+
+template<typename Scalar>
+template<typename Expr>
+Matrix<Scalar>& Matrix<Scalar>::operator+=(const MatrixExpr<Expr>& expr) {
+   if (expr.derived().getRows() != rows || expr.derived().getCols() != cols) {
+      throw std::invalid_argument("Matrices are not conformant for elementwise operation");
+   }
+   if (detail::unsafeAlias(expr.derived(), matrix_data, static_cast<std::size_t>(rows) * cols)) {
+      Matrix<Scalar> operand(expr);
+      return *this += operand;
+   }
+   LINEAR_ALGEBRA_INSTRUMENT(Elementwise, std::max(rows, cols), 0.0, double(rows) * cols * sizeof(Scalar));
+   detail::accumulateElementwise(matrix_data, expr.derived(), Scalar(1));
+   return *this;
+}
+
+template<typename Scalar>
+template<typename Expr>
+Matrix<Scalar>& Matrix<Scalar>::operator-=(const MatrixExpr<Expr>& expr) {
+   if (expr.derived().getRows() != rows || expr.derived().getCols() != cols) {
+      throw std::invalid_argument("Matrices are not conformant for elementwise operation");
+   }
+   if (detail::unsafeAlias(expr.derived(), matrix_data, static_cast<std::size_t>(rows) * cols)) {
+      Matrix<Scalar> operand(expr);
+      return *this -= operand;
+   }
+   LINEAR_ALGEBRA_INSTRUMENT(Elementwise, std::max(rows, cols), 0.0, double(rows) * cols * sizeof(Scalar));
+   detail::accumulateElementwise(matrix_data, expr.derived(), Scalar(-1));
+   return *this;
+}
+
+template<typename Scalar>
+template<typename LeftScalar, typename RightScalar>
+Matrix<Scalar>& Matrix<Scalar>::operator+=(const ProductExpr<Scalar, LeftScalar, RightScalar>& product) {
+   if (product.getRows() != rows || product.getCols() != cols) {
+      throw std::invalid_argument("Matrices are not conformant for addition");
+   }
+   if (product.aliases(matrix_data, static_cast<std::size_t>(rows) * cols)) {
+      Matrix<Scalar> result(product);
+      return *this += result;
+   }
+   product.evaluateInto(Scalar(1), matrix_data);
+   return *this;
+}
+
+template<typename Scalar>
+template<typename LeftScalar, typename RightScalar>
+Matrix<Scalar>& Matrix<Scalar>::operator-=(const ProductExpr<Scalar, LeftScalar, RightScalar>& product) {
+   if (product.getRows() != rows || product.getCols() != cols) {
+      throw std::invalid_argument("Matrices are not conformant for addition");
+   }
+   if (product.aliases(matrix_data, static_cast<std::size_t>(rows) * cols)) {
+      Matrix<Scalar> result(product);
+      return *this -= result;
+   }
+   product.evaluateInto(Scalar(1), matrix_data, Scalar(-1));
+   return *this;
+}
+
+template<typename Scalar>
+Matrix<Scalar> Matrix<Scalar>::load(const std::string& path) {
+   static_assert(detail::DataTypeOf<Scalar>::code != 0, "Scalar type has no binary file representation.");
+   std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+   if (!file) {
+      throw std::runtime_error("Cannot open matrix file " + path);
+   }
+   std::uint64_t file_size = static_cast<std::uint64_t>(file.tellg());
+   detail::BinaryHeader header;
+   std::memset(&header, 0, sizeof(header));
+   file.seekg(0);
+   file.read(reinterpret_cast<char*>(&header), sizeof(header));
+   std::uint64_t extent = detail::checkBinaryHeader<Scalar>(header, file_size, path);
+   LINEAR_ALGEBRA_INSTRUMENT(FileIO, std::max(header.rows, header.cols), 0.0, double(sizeof(header)) + extent);
+
+   Matrix<Scalar> result(static_cast<int>(header.rows), static_cast<int>(header.cols));
+   file.seekg(static_cast<std::streamoff>(header.data_offset));
+   if (header.col_stride == 1 && header.row_stride == header.cols) {
+      file.read(reinterpret_cast<char*>(result.matrix_data), static_cast<std::streamsize>(extent));
+   } else {
+      std::vector<Scalar> stored(extent / sizeof(Scalar));
+      file.read(reinterpret_cast<char*>(stored.data()), static_cast<std::streamsize>(extent));
+      detail::assignElementwise(result.matrix_data, detail::binaryView(header, stored.data()));
+   }
+   if (!file) {
+      throw std::runtime_error("Cannot read matrix file " + path);
+   }
+   return result;
+}
+
+namespace detail {
+
+// True if the W pointers of a full group are evenly spaced, i.e. the group is rows of one strided matrix.
+template<typename Scalar, typename Pointer>
+bool evenlySpaced(Pointer const* pointers, int lanes, std::ptrdiff_t& spacing) {
+   const int W = BatchWidth<Scalar>::value;
+   spacing = lanes > 1 ? pointers[1] - pointers[0] : 0;
+   if (lanes != W || W % TransposeTile<Scalar>::size != 0) {
+      return false;
+   }
+   for (int w = 2; w < lanes; ++w) {
+      if (pointers[w] != pointers[0] + w * spacing) {
+         return false;
+      }
+   }
+   return true;
+}
+
+/**
+ * Interleaves "size" elements of each of the matrices of a group: dst[e * W + w] = sources[w][e], with zeros for
+ * lanes past "lanes". This is a transpose of the group, so evenly spaced groups go through the transpose tile kernel.
+*/
+template<typename Scalar>
+void interleaveGroup(const Scalar* const* sources, int lanes, std::size_t size, Scalar* dst, const KernelTable<Scalar>& table) {
+   const int W = BatchWidth<Scalar>::value, T = TransposeTile<Scalar>::size;
+   std::ptrdiff_t spacing;
+   std::size_t e = 0;
+   if (evenlySpaced<Scalar>(sources, lanes, spacing)) {
+      for (; e + T <= size; e += T) {
+         for (int w = 0; w < W; w += T) {
+            table.transpose_tile(sources[0] + w * spacing + e, spacing, dst + e * W + w, W);
+         }
+      }
+   }
+   for (; e < size; ++e) {
+      for (int w = 0; w < W; ++w) dst[e * W + w] = w < lanes ? sources[w][e] : Scalar(0);
+   }
+}
+
+// Inverse of interleaveGroup() for the first "lanes" matrices of a group: targets[w][e] = src[e * W + w].
+template<typename Scalar>
+void deinterleaveGroup(const Scalar* src, Scalar* const* targets, int lanes, std::size_t size, const KernelTable<Scalar>& table) {
+   const int W = BatchWidth<Scalar>::value, T = TransposeTile<Scalar>::size;
+   std::ptrdiff_t spacing;
+   std::size_t e = 0;
+   if (evenlySpaced<Scalar>(targets, lanes, spacing) && spacing >= static_cast<std::ptrdiff_t>(size)) {
+      for (; e + T <= size; e += T) {
+         for (int w = 0; w < W; w += T) {
+            table.transpose_tile(src + e * W + w, W, targets[0] + w * spacing + e, spacing);
+         }
+      }
+   }
+   for (; e < size; ++e) {
+      for (int w = 0; w < lanes; ++w) targets[w][e] = src[e * W + w];
+   }
+}
+
+/**
+ * Shared implementation of batchMultiply(): gathers BatchWidth matrices at a time into interleaved scratch buffers,
+ * runs the batch kernel and scatters the results. Groups are spread over the thread pool once the batch is large
+ * enough. left(i), right(i) and result(i) return the row-major storage of matrix i of each batch.
+*/
+template<typename Scalar, typename Left, typename Right, typename Result>
+void batchMultiplyGroups(int batch, int m, int n, int k, const Left& left, const Right& right, const Result& result) {
+   const int W = BatchWidth<Scalar>::value;
+   const int groups = (batch + W - 1) / W;
+   const std::size_t a_size = static_cast<std::size_t>(m) * k, b_size = static_cast<std::size_t>(k) * n,
+                     c_size = static_cast<std::size_t>(m) * n;
+   LINEAR_ALGEBRA_INSTRUMENT(BatchMultiply, std::max(m, std::max(n, k)), 2.0 * batch * m * n * k,
+                             double(batch) * (a_size + b_size + c_size) * sizeof(Scalar));
+   auto run = [&](int first_group, int last_group) {
+      Scalar* a_lanes = scratchBuffer<Scalar, 2>(a_size * W);
+      Scalar* b_lanes = scratchBuffer<Scalar, 3>(b_size * W);
+      Scalar* c_lanes = scratchBuffer<Scalar, 4>(c_size * W);
+      const KernelTable<Scalar>& table = kernels<Scalar>();
+      const Scalar* a_sources[W];
+      const Scalar* b_sources[W];
+      Scalar* c_targets[W];
+      for (int group = first_group; group < last_group; ++group) {
+         int lanes = std::min(W, batch - group * W);
+         for (int w = 0; w < lanes; ++w) {
+            a_sources[w] = left(group * W + w);
+            b_sources[w] = right(group * W + w);
+            c_targets[w] = result(group * W + w);
+         }
+         interleaveGroup(a_sources, lanes, a_size, a_lanes, table);
+         interleaveGroup(b_sources, lanes, b_size, b_lanes, table);
+         table.batch_kernel(m, n, k, a_lanes, b_lanes, c_lanes);
+         deinterleaveGroup(c_lanes, c_targets, lanes, c_size, table);
+      }
+   };
+
+   ThreadPool& pool = ThreadPool::global();
+   std::size_t work = static_cast<std::size_t>(batch) * c_size * std::max(k, 1);
+   if (pool.size() == 1 || groups < 2 || work < parallelThreshold()) {
+      run(0, groups);
+      return;
+   }
+   int tasks = std::min(groups, 4 * pool.size());
+   pool.parallelFor(tasks, [&](int task) {
+      run(static_cast<int>(static_cast<long long>(groups) * task / tasks),
+          static_cast<int>(static_cast<long long>(groups) * (task + 1) / tasks));
+   });
+}
+
+}  // End of namespace detail
+
+/**
+ * Multiplies a batch of independent, same-shape small matrices: C_i = A_i * B_i for i in [0, batch). Every matrix is
+ * dense row-major (the layout of a Matrix) and the matrices of a batch are "stride" elements apart, so a batch can be
+ * one contiguous array (stride = rows * cols), every other matrix of a larger array, or a single matrix shared by
+ * all products (stride 0). Internally groups of matrices are interleaved so that the SIMD lanes run across the
+ * batch, which keeps tiny products such as 8x8 vectorized where a single product could not be. Nothing is allocated
+ * beyond per-thread scratch buffers that are reused between calls.
+ * @param batch: Number of products.
+ * @param m: Rows of every A_i and C_i.
+ * @param n: Columns of every B_i and C_i.
+ * @param k: Columns of every A_i and rows of every B_i.
+ * @param a: First A matrix.
+ * @param stride_a: Distance in elements between consecutive A matrices.
+ * @param b: First B matrix.
+ * @param stride_b: Distance in elements between consecutive B matrices.
+ * @param c: First C matrix, preallocated and not overlapping any A or B matrix.
+ * @param stride_c: Distance in elements between consecutive C matrices, at least m * n.
+ * @throws An invalid_argument exception if a dimension or the batch size is negative.
+*/
+template<typename Scalar>
+void batchMultiply(int batch, int m, int n, int k, const Scalar* a, std::ptrdiff_t stride_a,
+                   const Scalar* b, std::ptrdiff_t stride_b, Scalar* c, std::ptrdiff_t stride_c) {
+   if (batch < 0 || m < 0 || n < 0 || k < 0) {
+      throw std::invalid_argument("Batch size and matrix dimensions must not be negative");
+   }
+   if (batch == 0 || m == 0 || n == 0) {
+      return;
+   }
+   detail::batchMultiplyGroups<Scalar>(batch, m, n, k,
+      [=](int i) { return a + i * stride_a; }, [=](int i) { return b + i * stride_b; },
+      [=](int i) { return c + i * stride_c; });
+}
+
+/**
+ * Batched multiplication of separately stored matrices: results[i] = left[i] * right[i].
+ * @param left: A matrices, all of the same shape.
+ * @param right: B matrices, all of the same shape, as many as left.
+ * @param results: Receives the products, must be a different vector than left and right and hold as many matrices
+ *    as left. Each is resized to the product's shape, which reuses its buffer when it already has room.
+ * @throws An invalid_argument exception if the batches differ in size or contain matrices of different shapes.
+*/
+template<typename Scalar>
+void batchMultiply(const std::vector<Matrix<Scalar>>& left, const std::vector<Matrix<Scalar>>& right,
+                   std::vector<Matrix<Scalar>>& results) {
+   if (left.size() != right.size() || left.size() != results.size()) {
+      throw std::invalid_argument("Batches must contain the same number of matrices");
+   }
+   if (left.empty()) {
+      return;
+   }
+   const int m = left[0].getRows(), k = left[0].getCols(), n = right[0].getCols();
+   for (std::size_t i = 0; i < left.size(); ++i) {
+      if (left[i].getRows() != m || left[i].getCols() != k || right[i].getRows() != k || right[i].getCols() != n) {
+         throw std::invalid_argument("Matrices are not conformant for batched multiplication");
+      }
+      detail::MatrixAccess::reshapeDiscard(results[i], m, n);
+   }
+   if (m == 0 || n == 0) {
+      return;
+   }
+   detail::batchMultiplyGroups<Scalar>(static_cast<int>(left.size()), m, n, k,
+      [&](int i) { return detail::MatrixAccess::data(left[i]); },
+      [&](int i) { return detail::MatrixAccess::data(right[i]); },
+      [&](int i) { return detail::MatrixAccess::data(results[i]); });
+}
+
+/**
+ * Source of matrix tiles for streamingMultiply(), e.g. a file on disk or a matrix in memory. streamingMultiply()
+ * calls readTile() from a background I/O thread, but never concurrently with another readTile() or writeTile() of
+ * the same call.
+*/
+template<typename Scalar>
+class TileSource
+{
+   public:
+      virtual ~TileSource() {}
+      virtual int getRows() const = 0;
+      virtual int getCols() const = 0;
+
+      /**
+       * Copies the tile of tile_rows x tile_cols elements starting at (first_row, first_col) into a row-major buffer.
+       * @param dst: Destination of the tile.
+       * @param ldd: Row stride of dst, at least tile_cols.
+       */
+      virtual void readTile(int first_row, int first_col, int tile_rows, int tile_cols, Scalar* dst, std::ptrdiff_t ldd) = 0;
+};
+
+/**
+ * Destination of matrix tiles for streamingMultiply(). writeTile() is called from a background I/O thread, one tile
+ * at a time and in the order the tiles are finished.
+*/
+template<typename Scalar>
+class TileSink
+{
+   public:
+      virtual ~TileSink() {}
+      virtual int getRows() const = 0;
+      virtual int getCols() const = 0;
+
+      /**
+       * Stores a tile_rows x tile_cols tile from a row-major buffer at (first_row, first_col).
+       * @param src: The tile.
+       * @param lds: Row stride of src, at least tile_cols.
+       */
+      virtual void writeTile(int first_row, int first_col, int tile_rows, int tile_cols, const Scalar* src, std::ptrdiff_t lds) = 0;
+};
+
+/**
+ * Tiles of a matrix that is already in memory (a Matrix, MappedMatrix, FixedMatrix or any external buffer),
+ * read through its view. The view must stay valid while the tiles are used.
+*/
+template<typename Scalar>
+class ViewTileSource : public TileSource<Scalar>
+{
+   private:
+      MatrixView<const Scalar> tiles_view;
+
+   public:
+      explicit ViewTileSource(const MatrixView<const Scalar>& view) : tiles_view(view) {}
+
+      int getRows() const { return tiles_view.getRows(); }
+      int getCols() const { return tiles_view.getCols(); }
+
+      void readTile(int first_row, int first_col, int tile_rows, int tile_cols, Scalar* dst, std::ptrdiff_t ldd) {
+         MatrixView<const Scalar> tile = tiles_view.block(first_row, first_col, tile_rows, tile_cols);
+         for (int i = 0; i < tile_rows; ++i) {
+            for (int j = 0; j < tile_cols; ++j) {
+               dst[i * ldd + j] = tile.data()[i * tile.rowStep() + j * tile.colStep()];
+            }
+         }
+      }
+};
+
+// Writes tiles into a matrix in memory through its view, the counterpart of ViewTileSource.
+template<typename Scalar>
+class ViewTileSink : public TileSink<Scalar>
+{
+   private:
+      MatrixView<Scalar> tiles_view;
+
+   public:
+      explicit ViewTileSink(const MatrixView<Scalar>& view) : tiles_view(view) {}
+
+      int getRows() const { return tiles_view.getRows(); }
+      int getCols() const { return tiles_view.getCols(); }
+
+      void writeTile(int first_row, int first_col, int tile_rows, int tile_cols, const Scalar* src, std::ptrdiff_t lds) {
+         MatrixView<Scalar> tile = tiles_view.block(first_row, first_col, tile_rows, tile_cols);
+         for (int i = 0; i < tile_rows; ++i) {
+            for (int j = 0; j < tile_cols; ++j) {
+               tile.data()[i * tile.rowStep() + j * tile.colStep()] = src[i * lds + j];
+            }
+         }
+      }
+};
+
+#if LINEAR_ALGEBRA_HAS_MMAP
 /**
- * The Linear Algebra library currently contains a Matrix class with its associated constructors, some overloaded operators,
- * getters & setters, and two primary methods:
- * 
- * 1) A multiplication method, implemented via the overloaded "*" operator
- * 2) A transpose method
- * 
- * The primary implementation of the Matrix itself is via the use of a C style contiguos array, instead of the more
- * straightforward nested vector implementation. This allows for slightly better access times and performance. 
- * This "flattened" matrix is accessed and manipulated with the member methods of the Matrix class. The Matrix is also
- * 0-indexed based with a getter and setter for accessing elements.
+ * Binary matrix file (see Matrix::save()) accessed tile by tile with pread/pwrite, so only the tiles in use are
+ * ever in memory. Serves as both the operands and the result of streamingMultiply(). Move-only.
 */
-namespace LinearAlgebra {
-
-// Class for representing a matrix with generic Scalar type, this can include int, double, float etc.
-template<typename Scalar> 
-class Matrix 
+template<typename Scalar>
+class MatrixFile : public TileSource<Scalar>, public TileSink<Scalar>
 {
-   protected:
-      
-      Scalar* matrix_data; // Pointer to the flattened matrix data.
-      int rows; // Number of rows in the matrix.
-      int cols; // Number of columns in the matrix.
+   private:
+      int descriptor; // Open file, or -1 after a move.
+      detail::BinaryHeader header; // Layout of the file, row-major.
+      std::string file_path;
+
+      MatrixFile(int input_descriptor, const detail::BinaryHeader& input_header, const std::string& path)
+         : descriptor(input_descriptor), header(input_header), file_path(path) {}
+
+      // Offset of element (row, col) from the start of the file.
+      off_t offsetOf(int row, int col) const {
+         return static_cast<off_t>(header.data_offset + (static_cast<std::uint64_t>(row) * header.row_stride + col) * sizeof(Scalar));
+      }
 
+      void checkTile(int first_row, int first_col, int tile_rows, int tile_cols) const {
+         if (first_row < 0 || first_col < 0 || tile_rows < 0 || tile_cols < 0 ||
+             first_row + tile_rows > header.rows || first_col + tile_cols > header.cols) {
+            throw std::out_of_range("Tile exceeds matrix dimensions");
+         }
+      }
+
+   public:
       /**
-       * Helper function to initialize matrix_data from a 2D range (like 2D vector or initializer list).
-       * 
-       * @param input_list: Either a 2D vector or nested initializer list
-       * @throws Throws an exception if the provided range exceeds matrix dimensions 
-       *    or if the number of elements in a data row is incorrect.
-      */ 
-      template<typename RangeType>
-      void initializeFrom2DRange(const RangeType& input_list) {
-         int row = 0;
-         for (const auto& curr_row : input_list) {
-            int col = 0;
-            for (const auto& elem : curr_row) {
-               if (row >= rows || col >= cols) {
-                  throw std::out_of_range("Data exceeds matrix dimensions");
-               }
-               matrix_data[row * cols + col] = elem;
-               col++;
+       * Constructor: Opens an existing binary matrix file.
+       * @param path: File written by Matrix::save() or MatrixFile::create().
+       * @param writable: Whether tiles will be written to the file.
+       * @throws A runtime_error exception if the file cannot be opened, and an invalid_argument exception if it is
+       *    not a row-major matrix file of this Scalar type.
+       */
+      explicit MatrixFile(const std::string& path, bool writable = false)
+         : descriptor(open(path.c_str(), writable ? O_RDWR : O_RDONLY)), file_path(path) {
+         struct stat status;
+         if (descriptor < 0 || fstat(descriptor, &status) != 0) {
+            if (descriptor >= 0) {
+               close(descriptor);
             }
-            if (col != cols) {
-               throw std::invalid_argument("Incorrect number of elements in data row");
+            throw std::runtime_error("Cannot open matrix file " + path);
+         }
+         std::memset(&header, 0, sizeof(header));
+         try {
+            if (pread(descriptor, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+               throw std::invalid_argument(path + " is not a matrix file");
             }
-            row++;
+            detail::checkBinaryHeader<Scalar>(header, static_cast<std::uint64_t>(status.st_size), path);
+            if (header.col_stride != 1) {
+               throw std::invalid_argument(path + " is not stored row-major");
+            }
+         } catch (...) {
+            close(descriptor);
+            throw;
          }
       }
 
-   public:
       /**
-       * Default Constructor: Initialize an empty matrix with specified dimensions.
-       * @param input_rows: Number of rows for the new matrix.
-       * @param input_cols: Number of columns for the new matrix.
+       * Creates a new rows x cols matrix file of unspecified contents (sparse where the file system allows it),
+       * to be filled with writeTile().
+       * @param path: File to create or overwrite.
+       * @throws An invalid_argument exception if a dimension is negative or the file would exceed the largest file
+       *    offset, and a runtime_error exception if the file cannot be created.
+       * @returns: The file, open for reading and writing.
        */
-      Matrix(int input_rows, int input_cols) 
-         : matrix_data(new Scalar[input_rows * input_cols]), rows(input_rows), cols(input_cols) {}
+      static MatrixFile create(const std::string& path, int rows, int cols) {
+         static_assert(detail::DataTypeOf<Scalar>::code != 0, "Scalar type has no binary file representation.");
+         const std::size_t count = detail::elementCount(rows, cols);
+         const std::uint64_t max_size = static_cast<std::uint64_t>(std::numeric_limits<off_t>::max());
+         if (count > (max_size - sizeof(detail::BinaryHeader)) / sizeof(Scalar)) {
+            throw std::invalid_argument("Matrix is too large for a matrix file");
+         }
+         detail::BinaryHeader header;
+         std::memset(&header, 0, sizeof(header));
+         std::memcpy(header.magic, detail::kBinaryMagic, sizeof(detail::kBinaryMagic));
+         header.version = detail::kBinaryVersion;
+         header.byte_order = detail::kBinaryByteOrder;
+         header.data_type = detail::DataTypeOf<Scalar>::code;
+         header.element_size = sizeof(Scalar);
+         header.alignment = detail::kStorageAlignment;
+         header.rows = rows;
+         header.cols = cols;
+         header.row_stride = cols;
+         header.col_stride = 1;
+         header.data_offset = sizeof(header);
+         int descriptor = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+         if (descriptor < 0) {
+            throw std::runtime_error("Cannot create matrix file " + path);
+         }
+         off_t size = static_cast<off_t>(sizeof(header) + count * sizeof(Scalar));
+         if (pwrite(descriptor, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+             ftruncate(descriptor, size) != 0) {
+            close(descriptor);
+            throw std::runtime_error("Cannot write matrix file " + path);
+         }
+         return MatrixFile(descriptor, header, path);
+      }
 
-       /**
-       * Constructor to initialize matrix using an initializer list.
-       * 
-       * Example: LinearAlgebra::Matrix<int> matrix(2, 2, {{1, 2}, {3, 4}});
-       * 
-       * @param input_rows: Number of rows for the new matrix.
-       * @param input_cols: Number of columns for the new matrix.
-       * @param init_list: Initializer list to populate the matrix.
-       */
-      Matrix(int input_rows, int input_cols, std::initializer_list<std::initializer_list<Scalar>> init_list) 
-         : matrix_data(new Scalar[input_rows * input_cols]), rows(input_rows), cols(input_cols) {
-         initializeFrom2DRange(init_list);
+      MatrixFile(MatrixFile&& other) noexcept
+         : descriptor(other.descriptor), header(other.header), file_path(std::move(other.file_path)) {
+         other.descriptor = -1;
       }
 
-      /**
-       * Constructor to initialize matrix using a 2D vector.
-       * @param input_rows: Number of rows for the matrix.
-       * @param input_cols: Number of columns for the matrix.
-       * @param input_vector: 2D vector to populate the matrix.
-       */
-      Matrix(int input_rows, int input_cols, const std::vector<std::vector<Scalar>>& input_vector) 
-         : matrix_data(new Scalar[input_rows * input_cols]), rows(input_rows), cols(input_cols) {
-         initializeFrom2DRange(input_vector);
+      MatrixFile(const MatrixFile&) = delete;
+      MatrixFile& operator=(const MatrixFile&) = delete;
+
+      ~MatrixFile() {
+         if (descriptor >= 0) {
+            close(descriptor);
+         }
+      }
+
+      int getRows() const { return static_cast<int>(header.rows); }
+      int getCols() const { return static_cast<int>(header.cols); }
+
+      void readTile(int first_row, int first_col, int tile_rows, int tile_cols, Scalar* dst, std::ptrdiff_t ldd) {
+         checkTile(first_row, first_col, tile_rows, tile_cols);
+         for (int i = 0; i < tile_rows; ++i) {
+            char* out = reinterpret_cast<char*>(dst + i * ldd);
+            std::size_t remaining = static_cast<std::size_t>(tile_cols) * sizeof(Scalar);
+            off_t offset = offsetOf(first_row + i, first_col);
+            while (remaining > 0) {
+               ssize_t done = pread(descriptor, out, remaining, offset);
+               if (done <= 0) {
+                  throw std::runtime_error("Cannot read matrix file " + file_path);
+               }
+               out += done;
+               offset += done;
+               remaining -= static_cast<std::size_t>(done);
+            }
+         }
+      }
+
+      void writeTile(int first_row, int first_col, int tile_rows, int tile_cols, const Scalar* src, std::ptrdiff_t lds) {
+         checkTile(first_row, first_col, tile_rows, tile_cols);
+         for (int i = 0; i < tile_rows; ++i) {
+            const char* in = reinterpret_cast<const char*>(src + i * lds);
+            std::size_t remaining = static_cast<std::size_t>(tile_cols) * sizeof(Scalar);
+            off_t offset = offsetOf(first_row + i, first_col);
+            while (remaining > 0) {
+               ssize_t done = pwrite(descriptor, in, remaining, offset);
+               if (done <= 0) {
+                  throw std::runtime_error("Cannot write matrix file " + file_path);
+               }
+               in += done;
+               offset += done;
+               remaining -= static_cast<std::size_t>(done);
+            }
+         }
+      }
+};
+#endif
+
+namespace detail {
+
+/**
+ * One background thread that runs submitted tasks one after another in submission order. streamingMultiply() sends
+ * all tile reads and writes of a call through one, so sources and sinks never see concurrent calls and no thread is
+ * created per tile.
+*/
+class SerialExecutor
+{
+   private:
+      std::deque<std::packaged_task<void()>> tasks;
+      std::mutex mutex;
+      std::condition_variable available;
+      bool stopping;
+      std::thread worker;
+
+      void run() {
+         for (;;) {
+            std::packaged_task<void()> task;
+            {
+               std::unique_lock<std::mutex> lock(mutex);
+               available.wait(lock, [this] { return stopping || !tasks.empty(); });
+               if (tasks.empty()) {
+                  return;
+               }
+               task = std::move(tasks.front());
+               tasks.pop_front();
+            }
+            task(); // Exceptions end up in the task's future.
+         }
+      }
+
+   public:
+      SerialExecutor() : stopping(false), worker(&SerialExecutor::run, this) {}
+
+      SerialExecutor(const SerialExecutor&) = delete;
+      SerialExecutor& operator=(const SerialExecutor&) = delete;
+
+      // Destructor: Runs the tasks still queued, then stops the thread.
+      ~SerialExecutor() {
+         {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+         }
+         available.notify_one();
+         worker.join();
       }
 
       /**
-       * Copy constructor.
-       * @param other: Another matrix object to be copied.
+       * Queues a task behind the ones submitted before.
+       * @param function: Callable without arguments.
+       * @returns: A future that becomes ready, or receives the task's exception, once the task ran.
        */
-      Matrix(const Matrix<Scalar>& other) 
-         : matrix_data(new Scalar[other.rows * other.cols]), rows(other.rows), cols(other.cols) {
-         std::copy(other.matrix_data, other.matrix_data + rows * cols, matrix_data);
+      template<typename Function>
+      std::future<void> submit(Function function) {
+         std::packaged_task<void()> task(std::move(function));
+         std::future<void> result = task.get_future();
+         {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+         }
+         available.notify_one();
+         return result;
+      }
+};
+
+}  // End of namespace detail
+
+/**
+ * Out-of-core multiplication C = A * B for matrices that do not fit in memory. C is produced one square tile at a
+ * time: for each tile the matching row panel of A and column panel of B are streamed through in tile-sized pieces
+ * and multiplied with the packed (and, above the parallel threshold, multithreaded) GEMM. Reads of the next pair of
+ * tiles and the write of the previous C tile run on one I/O thread (detail::SerialExecutor) that lives for the whole
+ * call, while the current block product is computed.
+ *
+ * Two tiles of A, two of B and two of C are resident at a time, so tiles are chosen as large as the budget allows
+ * (a multiple of 64 once that is at least 64), which also minimizes how often A and B are re-read: A is read
+ * cols(C) / tile times and B rows(C) / tile times.
+ * @param a: Left operand, m x k.
+ * @param b: Right operand, k x n.
+ * @param c: Receives the m x n product. Must not be the same storage as a or b.
+ * @param memory_budget: Bytes of tile buffers to use at most.
+ * @throws An invalid_argument exception if the shapes are not conformant or the budget cannot hold six single
+ *    elements, and any exception thrown by the sources or the sink.
+*/
+template<typename Scalar>
+void streamingMultiply(TileSource<Scalar>& a, TileSource<Scalar>& b, TileSink<Scalar>& c,
+                       std::size_t memory_budget = std::size_t(256) << 20) {
+   const int m = a.getRows(), k = a.getCols(), n = b.getCols();
+   if (b.getRows() != k || c.getRows() != m || c.getCols() != n) {
+      throw std::invalid_argument("Matrices are not conformant for multiplication");
+   }
+   LINEAR_ALGEBRA_INSTRUMENT(StreamingMultiply, std::max(m, std::max(n, k)), 2.0 * m * n * k,
+                             (double(m) * k + double(k) * n + double(m) * n) * sizeof(Scalar));
+   std::size_t tile = static_cast<std::size_t>(std::sqrt(static_cast<double>(memory_budget / (6 * sizeof(Scalar)))));
+   while (tile * tile * 6 * sizeof(Scalar) > memory_budget) {
+      --tile;
+   }
+   if (tile == 0) {
+      throw std::invalid_argument("Memory budget is too small for streaming multiplication");
+   }
+   if (tile >= 64) {
+      tile -= tile % 64;
+   }
+   const int tile_m = static_cast<int>(std::min<std::size_t>(tile, std::max(m, 1)));
+   const int tile_n = static_cast<int>(std::min<std::size_t>(tile, std::max(n, 1)));
+   const int tile_k = static_cast<int>(std::min<std::size_t>(tile, std::max(k, 1)));
+   const int grid_m = (m + tile_m - 1) / tile_m, grid_n = (n + tile_n - 1) / tile_n;
+   const int grid_k = std::max((k + tile_k - 1) / tile_k, 1);
+
+   std::vector<Scalar> a_tiles[2], b_tiles[2], c_tiles[2];
+   for (int i = 0; i < 2; ++i) {
+      a_tiles[i].resize(static_cast<std::size_t>(tile_m) * tile_k);
+      b_tiles[i].resize(static_cast<std::size_t>(tile_k) * tile_n);
+      c_tiles[i].resize(static_cast<std::size_t>(tile_m) * tile_n);
+   }
+
+   // Step s multiplies A(i, p) by B(p, j) for C tile s / grid_k and p = s % grid_k.
+   const long long steps = static_cast<long long>(grid_m) * grid_n * grid_k;
+   auto load = [&](long long step, int slot) {
+      int block = static_cast<int>(step / grid_k), p = static_cast<int>(step % grid_k);
+      int i0 = (block / grid_n) * tile_m, j0 = (block % grid_n) * tile_n, p0 = p * tile_k;
+      int rows = std::min(tile_m, m - i0), cols = std::min(tile_n, n - j0), depth = std::min(tile_k, k - p0);
+      a.readTile(i0, p0, rows, depth, a_tiles[slot].data(), tile_k);
+      b.readTile(p0, j0, depth, cols, b_tiles[slot].data(), tile_n);
+   };
+
+   // Declared after the buffers, so if anything throws, the destructor finishes the transfers still queued before the
+   // buffers they use go away.
+   detail::SerialExecutor io;
+   std::future<void> prefetch, write_behind[2];
+   if (steps > 0) {
+      load(0, 0);
+   }
+   for (long long step = 0; step < steps; ++step) {
+      int slot = static_cast<int>(step % 2);
+      if (step + 1 < steps) {
+         prefetch = io.submit([&load, step, slot]() { load(step + 1, 1 - slot); });
+      }
+      int block = static_cast<int>(step / grid_k), p = static_cast<int>(step % grid_k);
+      int c_slot = block % 2;
+      int i0 = (block / grid_n) * tile_m, j0 = (block % grid_n) * tile_n, p0 = p * tile_k;
+      int rows = std::min(tile_m, m - i0), cols = std::min(tile_n, n - j0), depth = std::max(std::min(tile_k, k - p0), 0);
+      if (p == 0 && write_behind[c_slot].valid()) {
+         // Block - 2 was computed in this C buffer, its write must be done before the buffer is reused.
+         write_behind[c_slot].get();
       }
+      detail::gemmParallel(rows, cols, depth, Scalar(1), a_tiles[slot].data(), std::ptrdiff_t(tile_k), std::ptrdiff_t(1),
+                           b_tiles[slot].data(), std::ptrdiff_t(tile_n), std::ptrdiff_t(1),
+                           p == 0 ? Scalar(0) : Scalar(1), c_tiles[c_slot].data(), std::ptrdiff_t(tile_n));
+      if (p == grid_k - 1) {
+         write_behind[c_slot] = io.submit([&c, &c_tiles, c_slot, i0, j0, rows, cols, tile_n]() {
+            c.writeTile(i0, j0, rows, cols, c_tiles[c_slot].data(), tile_n);
+         });
+      }
+      if (prefetch.valid()) {
+         prefetch.get();
+      }
+   }
+   for (int i = 0; i < 2; ++i) {
+      if (write_behind[i].valid()) {
+         write_behind[i].get();
+      }
+   }
+}
+
+// Storage orders of a SparseMatrix: compressed sparse rows or compressed sparse columns.
+enum class SparseFormat { CSR, CSC };
+
+// One nonzero of a SparseMatrix, for building one from entries in any order.
+template<typename Scalar>
+struct SparseEntry {
+   int row;
+   int col;
+   Scalar value;
+};
+
+namespace detail {
+
+/**
+ * Counting sort of the nonzeros of a compressed matrix with "major" lines (rows for CSR, columns for CSC) and "minor"
+ * positions per line into the arrays of the same matrix compressed the other way round. That is both the CSR <-> CSC
+ * conversion and, read with the same format, the transpose. Indices come out ascending within every new line.
+ * O(nonzeros + major + minor).
+*/
+template<typename Scalar>
+void transposeCompressed(int major, int minor, const std::vector<std::size_t>& offsets, const std::vector<int>& indices,
+                         const std::vector<Scalar>& values, std::vector<std::size_t>& out_offsets,
+                         std::vector<int>& out_indices, std::vector<Scalar>& out_values) {
+   out_offsets.assign(static_cast<std::size_t>(minor) + 1, 0);
+   for (std::size_t e = 0; e < indices.size(); ++e) {
+      ++out_offsets[indices[e] + 1];
+   }
+   for (int i = 0; i < minor; ++i) {
+      out_offsets[i + 1] += out_offsets[i];
+   }
+   out_indices.resize(indices.size());
+   out_values.resize(values.size());
+   std::vector<std::size_t> next(out_offsets.begin(), out_offsets.end() - 1);
+   for (int line = 0; line < major; ++line) {
+      for (std::size_t e = offsets[line]; e < offsets[line + 1]; ++e) {
+         std::size_t position = next[indices[e]]++;
+         out_indices[position] = line;
+         out_values[position] = values[e];
+      }
+   }
+}
+
+/**
+ * Runs task(first, last) over consecutive ranges of the lines of a compressed matrix on the global pool. The ranges
+ * hold about the same number of nonzeros rather than the same number of lines, so a few dense rows do not leave the
+ * other workers idle. Stays on the calling thread when "work" is below parallelThreshold().
+*/
+inline void parallelForNonZeros(const std::vector<std::size_t>& offsets, std::size_t work,
+                                const std::function<void(int, int)>& task) {
+   int lines = static_cast<int>(offsets.size()) - 1;
+   ThreadPool& pool = ThreadPool::global();
+   if (pool.size() == 1 || work < parallelThreshold() || lines < 2) {
+      task(0, lines);
+      return;
+   }
+   int chunks = std::min(lines, 4 * pool.size());
+   std::vector<int> bounds(chunks + 1, lines);
+   bounds[0] = 0;
+   for (int c = 1; c < chunks; ++c) {
+      std::size_t target = static_cast<std::size_t>(static_cast<double>(offsets.back()) * c / chunks);
+      int line = static_cast<int>(std::lower_bound(offsets.begin(), offsets.end(), target) - offsets.begin());
+      bounds[c] = std::max(bounds[c - 1], std::min(line, lines));
+   }
+   pool.parallelFor(chunks, [&](int c) {
+      if (bounds[c] < bounds[c + 1]) {
+         task(bounds[c], bounds[c + 1]);
+      }
+   });
+}
+
+// Runs task(first, last) over "count" items split evenly into ranges of at least "grain" items on the global pool.
+inline void parallelForRanges(int count, int grain, std::size_t work, const std::function<void(int, int)>& task) {
+   ThreadPool& pool = ThreadPool::global();
+   int chunks = std::min(4 * pool.size(), std::max(count / std::max(grain, 1), 1));
+   if (pool.size() == 1 || work < parallelThreshold() || chunks < 2) {
+      task(0, count);
+      return;
+   }
+   pool.parallelFor(chunks, [&](int c) {
+      int first = static_cast<int>(static_cast<long long>(count) * c / chunks);
+      int last = static_cast<int>(static_cast<long long>(count) * (c + 1) / chunks);
+      if (first < last) {
+         task(first, last);
+      }
+   });
+}
+
+}  // End of namespace detail
+
+/**
+ * Sparse matrix in compressed sparse row (CSR) or compressed sparse column (CSC) form: for each row (CSR) or column
+ * (CSC) the column or row indices of its nonzeros in ascending order and their values, stored contiguously, plus one
+ * offset per row or column into those arrays. Memory and the cost of every operation grow with the number of nonzeros
+ * instead of rows * cols.
+ *
+ * Products with dense matrices (operator*) and vectors (multiply()) run on the library's thread pool, split by
+ * nonzeros. CSR is the faster format for sparse * dense and SpMV, where every row of the result is independent and
+ * the rows of the dense operand are added with the SIMD axpy kernel. toFormat() converts between the two forms.
+*/
+template<typename Scalar>
+class SparseMatrix
+{
+   private:
+
+      int rows; // Number of rows in the matrix.
+      int cols; // Number of columns in the matrix.
+      SparseFormat format; // Whether lines are rows (CSR) or columns (CSC).
+      std::vector<std::size_t> offsets; // Start of each line in indices and values, followed by the end of the last.
+      std::vector<int> indices; // Column (CSR) or row (CSC) of each nonzero, ascending within a line.
+      std::vector<Scalar> values; // Value of each nonzero.
+
+      int lines() const { return format == SparseFormat::CSR ? rows : cols; }
+      int lineLength() const { return format == SparseFormat::CSR ? cols : rows; }
+
+      SparseMatrix(int input_rows, int input_cols, SparseFormat input_format, std::vector<std::size_t>&& input_offsets,
+                   std::vector<int>&& input_indices, std::vector<Scalar>&& input_values, std::false_type)
+         : rows(input_rows), cols(input_cols), format(input_format), offsets(std::move(input_offsets)),
+           indices(std::move(input_indices)), values(std::move(input_values)) {}
+
+      // Number of offsets of a rows x cols matrix in the given format.
+      // @throws An invalid_argument exception if a dimension is negative.
+      static std::size_t offsetCount(int rows, int cols, SparseFormat format) {
+         detail::elementCount(rows, cols);
+         return static_cast<std::size_t>(format == SparseFormat::CSR ? rows : cols) + 1;
+      }
+
+   public:
+      typedef Scalar scalar_type;
 
       /**
-       * Move constructor for efficient matrix creation by moving data.
-       * @param other: Another matrix object.
+       * Constructor: All-zero matrix.
+       * @param input_rows: Number of rows.
+       * @param input_cols: Number of columns.
+       * @param input_format: CSR or CSC.
+       * @throws An invalid_argument exception if a dimension is negative.
        */
-      Matrix(Matrix<Scalar>&& other) noexcept
-         : matrix_data(std::move(other.matrix_data)), rows(std::move(other.rows)), cols(std::move(other.cols)) {}
-      
+      SparseMatrix(int input_rows, int input_cols, SparseFormat input_format = SparseFormat::CSR)
+         : rows(input_rows), cols(input_cols), format(input_format),
+           offsets(offsetCount(input_rows, input_cols, input_format), 0) {}
+
       /**
-       * Copy assignment operator.
-       * @param other: Another matrix object to be copied.
-       * @returns: This matrix object after copying data from the provided matrix.
+       * Constructor: Takes over ready-made compressed arrays, e.g. read from another library.
+       * @param input_offsets: getRows() + 1 (CSR) or getCols() + 1 (CSC) non-decreasing offsets, starting at 0 and
+       *    ending at the number of nonzeros.
+       * @param input_indices: Column (CSR) or row (CSC) of each nonzero, strictly ascending within a row / column.
+       * @param input_values: Value of each nonzero.
+       * @throws An invalid_argument exception if a dimension is negative or the arrays do not describe a valid matrix
+       *    of this shape.
        */
-      Matrix<Scalar>& operator=(Matrix<Scalar> other) {
-         std::swap(matrix_data, other.matrix_data);
-         std::swap(rows, other.rows);
-         std::swap(cols, other.cols);
-         return *this;
+      SparseMatrix(int input_rows, int input_cols, std::vector<std::size_t> input_offsets, std::vector<int> input_indices,
+                   std::vector<Scalar> input_values, SparseFormat input_format = SparseFormat::CSR)
+         : rows(input_rows), cols(input_cols), format(input_format), offsets(std::move(input_offsets)),
+           indices(std::move(input_indices)), values(std::move(input_values)) {
+         if (offsets.size() != offsetCount(rows, cols, format) || offsets.front() != 0 ||
+             offsets.back() != indices.size() || indices.size() != values.size()) {
+            throw std::invalid_argument("Compressed arrays do not match the matrix size");
+         }
+         for (int line = 0; line < lines(); ++line) {
+            if (offsets[line] > offsets[line + 1]) {
+               throw std::invalid_argument("Compressed offsets must not decrease");
+            }
+            for (std::size_t e = offsets[line]; e < offsets[line + 1]; ++e) {
+               if (indices[e] < 0 || indices[e] >= lineLength() || (e > offsets[line] && indices[e] <= indices[e - 1])) {
+                  throw std::invalid_argument("Compressed indices must be in range and ascending");
+               }
+            }
+         }
       }
 
       /**
-       * Move assignment operator for efficient matrix assignment.
-       * @param other: Another matrix object.
-       * @returns: This matrix object after moving data from the provided matrix.
+       * Constructor: Matrix from nonzero entries in any order. Entries at the same position are summed.
+       * @param entries: Row, column and value of each entry.
+       * @throws An out_of_range exception if an entry lies outside the matrix.
        */
-      Matrix<Scalar>& operator=(Matrix<Scalar>&& other) noexcept {
-         matrix_data = std::move(other.matrix_data);
-         rows = std::move(other.rows);
-         cols = std::move(other.cols);
-         return *this;
+      SparseMatrix(int input_rows, int input_cols, const std::vector<SparseEntry<Scalar>>& entries,
+                   SparseFormat input_format = SparseFormat::CSR)
+         : SparseMatrix(input_rows, input_cols, input_format) {
+         const bool csr = format == SparseFormat::CSR;
+         for (const SparseEntry<Scalar>& entry : entries) {
+            if (entry.row < 0 || entry.row >= rows || entry.col < 0 || entry.col >= cols) {
+               throw std::out_of_range("Specified index is out of bounds");
+            }
+            ++offsets[(csr ? entry.row : entry.col) + 1];
+         }
+         for (int line = 0; line < lines(); ++line) {
+            offsets[line + 1] += offsets[line];
+         }
+         std::vector<std::pair<int, Scalar>> placed(entries.size());
+         std::vector<std::size_t> next(offsets.begin(), offsets.end() - 1);
+         for (const SparseEntry<Scalar>& entry : entries) {
+            placed[next[csr ? entry.row : entry.col]++] = std::make_pair(csr ? entry.col : entry.row, entry.value);
+         }
+         // Sort every line by index and merge duplicates, compacting in place.
+         std::size_t out = 0;
+         for (int line = 0; line < lines(); ++line) {
+            std::size_t begin = offsets[line], end = offsets[line + 1];
+            std::sort(placed.begin() + begin, placed.begin() + end,
+                      [](const std::pair<int, Scalar>& left, const std::pair<int, Scalar>& right) { return left.first < right.first; });
+            offsets[line] = out;
+            for (std::size_t e = begin; e < end; ++e) {
+               if (out > offsets[line] && indices[out - 1] == placed[e].first) {
+                  values[out - 1] += placed[e].second;
+               } else {
+                  indices.push_back(placed[e].first);
+                  values.push_back(placed[e].second);
+                  ++out;
+               }
+            }
+         }
+         offsets[lines()] = out;
       }
 
-      // Destructor
-      ~Matrix(){ delete [] matrix_data; }
-
       /**
-       * GETTER
-       * Get the number of rows in the matrix.
-       * @returns: Number of rows in the matrix.
+       * Constructor: Compresses a dense Matrix, view or expression, keeping the elements that are not zero.
+       * @param dense: Source matrix.
+       * @param input_format: CSR or CSC.
        */
-      int getRows() const { return rows; }
+      template<typename Expr>
+      explicit SparseMatrix(const MatrixExpr<Expr>& dense, SparseFormat input_format = SparseFormat::CSR)
+         : SparseMatrix(dense.derived().getRows(), dense.derived().getCols(), input_format) {
+         static_assert(std::is_same<Scalar, typename Expr::scalar_type>::value,
+                       "Expression is of a different type than the matrix's Scalar type.");
+         const Expr& derived = dense.derived();
+         const bool csr = format == SparseFormat::CSR;
+         for (int line = 0; line < lines(); ++line) {
+            for (int position = 0; position < lineLength(); ++position) {
+               std::size_t flat = csr ? static_cast<std::size_t>(line) * cols + position
+                                      : static_cast<std::size_t>(position) * cols + line;
+               Scalar value = derived.coeff(flat);
+               if (value != Scalar(0)) {
+                  indices.push_back(position);
+                  values.push_back(value);
+               }
+            }
+            offsets[line + 1] = indices.size();
+         }
+      }
 
-      /**
-       * GETTER
-       * Get the number of columns in the matrix.
-       * @returns: Number of columns in the matrix.
-       */
+      int getRows() const { return rows; }
       int getCols() const { return cols; }
+      SparseFormat getFormat() const { return format; }
+
+      // Number of stored nonzeros.
+      std::size_t nonZeros() const { return values.size(); }
+
+      // The compressed arrays, see the class comment.
+      const std::vector<std::size_t>& getOffsets() const { return offsets; }
+      const std::vector<int>& getIndices() const { return indices; }
+      const std::vector<Scalar>& getValues() const { return values; }
 
       /**
        * GETTER
-       * Get the value of a specific cell in the matrix.
+       * Get the value of a specific cell, by binary search within its row (CSR) or column (CSC).
        * @param row: Row index of the cell.
        * @param col: Column index of the cell.
        * @throws An out_of_range exception if the input indexes are out of bounds.
-       * @returns: Value at the specified cell in the matrix.
+       * @returns: Value at the specified cell, zero if it is not stored.
        */
       Scalar get(int row, int col) const {
          if (row < 0 || row >= rows || col < 0 || col >= cols) {
             throw std::out_of_range("Specified index is out of bounds");
          }
-         return matrix_data[row * cols + col];
+         int line = format == SparseFormat::CSR ? row : col, position = format == SparseFormat::CSR ? col : row;
+         std::vector<int>::const_iterator first = indices.begin() + offsets[line], last = indices.begin() + offsets[line + 1];
+         std::vector<int>::const_iterator found = std::lower_bound(first, last, position);
+         return found != last && *found == position ? values[found - indices.begin()] : Scalar(0);
       }
 
       /**
-       * SETTER
-       * Set the value of a specific cell in the matrix.
-       * @param row: Row index of the cell.
-       * @param col: Column index of the cell.
-       * @param value: Value to set in the specified cell.
-       * @throws An out_of_range exception if the input indexes are out of bounds.
-       * @returns: Void. Updates the matrix cell with the provided value.
+       * Expands the matrix into dense storage.
+       * @returns: A rows x cols Matrix with zeros where nothing is stored.
        */
-      template<typename ValueType>
-      void set(int row, int col, ValueType value) {
-         static_assert(std::is_same<Scalar, ValueType>::value, "Provided value is of a different type than the matrix's Scalar type.");
+      Matrix<Scalar> toDense() const {
+         Matrix<Scalar> dense(rows, cols);
+         std::fill(dense.begin(), dense.end(), Scalar(0));
+         for (int line = 0; line < lines(); ++line) {
+            for (std::size_t e = offsets[line]; e < offsets[line + 1]; ++e) {
+               if (format == SparseFormat::CSR) {
+                  dense(line, indices[e]) = values[e];
+               } else {
+                  dense(indices[e], line) = values[e];
+               }
+            }
+         }
+         return dense;
+      }
 
-         if (row < 0 || row >= rows || col < 0 || col >= cols) {
-            throw std::out_of_range("Specified index is out of bounds");
+      /**
+       * Conversion between CSR and CSC, O(nonzeros + rows + cols).
+       * @param target: Format of the result.
+       * @returns: The same matrix stored in the target format.
+       */
+      SparseMatrix toFormat(SparseFormat target) const {
+         if (target == format) {
+            return *this;
          }
+         std::vector<std::size_t> new_offsets;
+         std::vector<int> new_indices;
+         std::vector<Scalar> new_values;
+         detail::transposeCompressed(lines(), lineLength(), offsets, indices, values, new_offsets, new_indices, new_values);
+         return SparseMatrix(rows, cols, target, std::move(new_offsets), std::move(new_indices), std::move(new_values),
+                             std::false_type());
+      }
 
-         matrix_data[row * cols + col] = value;
+      /**
+       * Transpose in the same format, O(nonzeros + rows + cols). toFormat() of the other format followed by swapping
+       * the dimensions would give the same arrays, because the CSR arrays of A are the CSC arrays of A^T.
+       * @returns: The cols x rows transpose.
+       */
+      SparseMatrix transposed() const {
+         std::vector<std::size_t> new_offsets;
+         std::vector<int> new_indices;
+         std::vector<Scalar> new_values;
+         detail::transposeCompressed(lines(), lineLength(), offsets, indices, values, new_offsets, new_indices, new_values);
+         return SparseMatrix(cols, rows, format, std::move(new_offsets), std::move(new_indices), std::move(new_values),
+                             std::false_type());
       }
 
       /**
-       * Overloaded insertion operator for streaming out the matrix content.
-       * Allows for easy printing of the matrix using standard output streams.
-       * @param os: The output stream to write to.
-       * @param matrix: The matrix object to be printed.
-       * @returns: The output stream after inserting the matrix content.
+       * Sparse matrix-vector product y = A * x into a caller-provided buffer. CSR runs the rows in parallel. CSC splits
+       * the columns into bands of equal nonzeros, one per pool thread; every band but the first scatters into a partial
+       * y of its own (getRows() elements each), and the partials are summed into y afterwards.
+       * @param x: getCols() elements.
+       * @param y: getRows() elements, overwritten. Must not overlap x.
        */
-      friend std::ostream& operator<< (std::ostream& os, const Matrix<Scalar>& matrix) {
-         for (int i = 0; i < matrix.rows; ++i) {
-               for (int j = 0; j < matrix.cols; ++j) {
-                  os << matrix.matrix_data[i * matrix.cols + j] << " ";
+      void multiply(const Scalar* x, Scalar* y) const {
+         LINEAR_ALGEBRA_INSTRUMENT(SparseMultiply, std::max(rows, cols), 2.0 * nonZeros(),
+                                   double(nonZeros()) * (sizeof(Scalar) + sizeof(int)) + double(rows + cols) * sizeof(Scalar));
+         if (format == SparseFormat::CSC) {
+            ThreadPool& pool = ThreadPool::global();
+            const int bands = std::min(cols, pool.size());
+            auto scatter = [&](int first, int last, Scalar* out) {
+               for (int col = first; col < last; ++col) {
+                  const Scalar x_value = x[col];
+                  for (std::size_t e = offsets[col]; e < offsets[col + 1]; ++e) {
+                     out[indices[e]] += values[e] * x_value;
+                  }
                }
-               os << std::endl;
+            };
+            std::fill(y, y + rows, Scalar(0));
+            if (bands < 2 || nonZeros() < parallelThreshold()) {
+               scatter(0, cols, y);
+               return;
+            }
+            std::vector<int> bounds(bands + 1, cols);
+            bounds[0] = 0;
+            for (int band = 1; band < bands; ++band) {
+               std::size_t target = static_cast<std::size_t>(static_cast<double>(nonZeros()) * band / bands);
+               int col = static_cast<int>(std::lower_bound(offsets.begin(), offsets.end(), target) - offsets.begin());
+               bounds[band] = std::max(bounds[band - 1], std::min(col, cols));
+            }
+            std::vector<Scalar> partial(static_cast<std::size_t>(bands - 1) * rows, Scalar(0));
+            pool.parallelFor(bands, [&](int band) {
+               scatter(bounds[band], bounds[band + 1], band == 0 ? y : partial.data() + static_cast<std::size_t>(band - 1) * rows);
+            });
+            detail::parallelForRanges(rows, 1024, static_cast<std::size_t>(rows) * bands, [&](int first, int last) {
+               for (int band = 1; band < bands; ++band) {
+                  const Scalar* band_y = partial.data() + static_cast<std::size_t>(band - 1) * rows;
+                  for (int row = first; row < last; ++row) {
+                     y[row] += band_y[row];
+                  }
+               }
+            });
+            return;
          }
-         return os;
+         detail::parallelForNonZeros(offsets, nonZeros(), [&](int first, int last) {
+            for (int row = first; row < last; ++row) {
+               Scalar sum(0);
+               for (std::size_t e = offsets[row]; e < offsets[row + 1]; ++e) {
+                  sum += values[e] * x[indices[e]];
+               }
+               y[row] = sum;
+            }
+         });
+      }
+
+      /**
+       * Sparse matrix-vector product.
+       * @throws An invalid_argument exception if x does not have getCols() elements.
+       * @returns: A * x.
+       */
+      friend std::vector<Scalar> operator*(const SparseMatrix& matrix, const std::vector<Scalar>& x) {
+         if (x.size() != static_cast<std::size_t>(matrix.cols)) {
+            throw std::invalid_argument("Matrices are not conformant for multiplication");
+         }
+         std::vector<Scalar> y(matrix.rows);
+         matrix.multiply(x.data(), y.data());
+         return y;
       }
 
       /**
-       * Overloaded multiplication operator for matrix multiplication.
-       * Performs matrix multiplication on two conformant matrices.
-       * Note: Both matrices should have the same Scalar type.
-       * @param other_matrix: The second matrix to multiply with.
-       * @returns: Resultant matrix after multiplication.
+       * Sparse times dense, C = A * B. Every nonzero A(i, p) adds A(i, p) times row p of B to row i of C through the
+       * SIMD axpy kernel. CSR splits the rows of C over the pool by nonzeros, CSC splits the columns of C.
+       * @throws An invalid_argument exception if the matrices are not conformant.
+       * @returns: The dense product.
        */
-      template<typename OtherScalar>
-      Matrix<Scalar> operator*(const Matrix<OtherScalar>& other_matrix) const {
-         
-         // Check if both matrices are of the same Scalar type
-         static_assert(std::is_same<Scalar, OtherScalar>::value, "Second matrix is of a different type than the first matrix's type.");
-         // Check if matrices are conformant.
-         if (cols != other_matrix.getRows()) { 
+      friend Matrix<Scalar> operator*(const SparseMatrix& left, const Matrix<Scalar>& right) {
+         if (left.cols != right.getRows()) {
             throw std::invalid_argument("Matrices are not conformant for multiplication");
          }
-         
-         int other_cols = other_matrix.getCols();
-         Matrix<Scalar> result(rows, other_cols);  // Initialize resultant matrix
-         for (int i = 0; i < rows; ++i) {
-            for (int j = 0; j < other_cols; ++j) {
-               result.matrix_data[i * other_cols + j] = 0; // Initialize result cell to 0
-               for (int k = 0; k < cols; ++k) {
-                     result.matrix_data[i * other_cols + j] += matrix_data[i * cols + k] * other_matrix.get(k, j); 
+         const int n = right.getCols();
+         Matrix<Scalar> result(left.rows, n);
+         LINEAR_ALGEBRA_INSTRUMENT(SparseMultiply, std::max(left.rows, std::max(left.cols, n)), 2.0 * left.nonZeros() * n,
+                                   double(left.nonZeros()) * (sizeof(Scalar) + sizeof(int)) +
+                                   (double(left.cols) + left.rows) * n * sizeof(Scalar));
+         void (*axpy)(std::size_t, Scalar, const Scalar*, Scalar*) = detail::kernels<Scalar>().axpy;
+         const Scalar* b = right.data();
+         Scalar* c = result.data();
+         const std::size_t work = left.nonZeros() * static_cast<std::size_t>(std::max(n, 1));
+         if (left.format == SparseFormat::CSR) {
+            detail::parallelForNonZeros(left.offsets, work, [&](int first, int last) {
+               std::fill(c + static_cast<std::size_t>(first) * n, c + static_cast<std::size_t>(last) * n, Scalar(0));
+               for (int row = first; row < last; ++row) {
+                  for (std::size_t e = left.offsets[row]; e < left.offsets[row + 1]; ++e) {
+                     axpy(n, left.values[e], b + static_cast<std::size_t>(left.indices[e]) * n,
+                          c + static_cast<std::size_t>(row) * n);
+                  }
                }
-            }
+            });
+         } else {
+            // Columns of C are independent, so each task handles a band of them for the whole of A.
+            detail::parallelForRanges(n, 64, work, [&](int first, int last) {
+               for (int row = 0; row < left.rows; ++row) {
+                  std::fill(c + static_cast<std::size_t>(row) * n + first, c + static_cast<std::size_t>(row) * n + last, Scalar(0));
+               }
+               for (int col = 0; col < left.cols; ++col) {
+                  for (std::size_t e = left.offsets[col]; e < left.offsets[col + 1]; ++e) {
+                     axpy(last - first, left.values[e], b + static_cast<std::size_t>(col) * n + first,
+                          c + static_cast<std::size_t>(left.indices[e]) * n + first);
+                  }
+               }
+            });
          }
          return result;
       }
 
       /**
-       * Transposes the current matrix by creating a new Matrix with swapped rows and cols.
-       * The function then swaps the values, deletes old matrix_data, and updates our matrix_data pointer 
-       * to the new transposed matrix.
-       * @returns: Void. The matrix object is transposed with matrix_data pointer updated.
+       * Dense times sparse, C = A * B. Each row of C only depends on the same row of A, so the rows of C are split
+       * over the pool; with a CSR B every A(i, p) scatters into row i of C, with a CSC B every C(i, j) is a gather
+       * over column j.
+       * @throws An invalid_argument exception if the matrices are not conformant.
+       * @returns: The dense product.
        */
-      void transpose() {
-      
-         Scalar* transposed_data = new Scalar[rows * cols];
-         for (int i = 0; i < rows; ++i) {
-            for (int j = 0; j < cols; ++j) {
-               transposed_data[j * rows + i] = matrix_data[i * cols + j];
-            }
+      friend Matrix<Scalar> operator*(const Matrix<Scalar>& left, const SparseMatrix& right) {
+         if (left.getCols() != right.rows) {
+            throw std::invalid_argument("Matrices are not conformant for multiplication");
          }
-         std::swap(rows, cols); // Swap the rows and columns values
-         delete[] matrix_data; // Cleanup old matrix_data and update pointer
-         matrix_data = transposed_data;
+         const int m = left.getRows(), k = left.getCols(), n = right.cols;
+         Matrix<Scalar> result(m, n);
+         LINEAR_ALGEBRA_INSTRUMENT(SparseMultiply, std::max(m, std::max(k, n)), 2.0 * right.nonZeros() * m,
+                                   double(right.nonZeros()) * (sizeof(Scalar) + sizeof(int)) +
+                                   (double(k) + n) * m * sizeof(Scalar));
+         const Scalar* a = left.data();
+         Scalar* c = result.data();
+         const std::size_t work = right.nonZeros() * static_cast<std::size_t>(std::max(m, 1));
+         detail::parallelForRanges(m, 1, work, [&](int first, int last) {
+            for (int row = first; row < last; ++row) {
+               const Scalar* a_row = a + static_cast<std::size_t>(row) * k;
+               Scalar* c_row = c + static_cast<std::size_t>(row) * n;
+               if (right.format == SparseFormat::CSR) {
+                  std::fill(c_row, c_row + n, Scalar(0));
+                  for (int p = 0; p < k; ++p) {
+                     const Scalar a_value = a_row[p];
+                     for (std::size_t e = right.offsets[p]; e < right.offsets[p + 1]; ++e) {
+                        c_row[right.indices[e]] += a_value * right.values[e];
+                     }
+                  }
+               } else {
+                  for (int col = 0; col < n; ++col) {
+                     Scalar sum(0);
+                     for (std::size_t e = right.offsets[col]; e < right.offsets[col + 1]; ++e) {
+                        sum += a_row[right.indices[e]] * right.values[e];
+                     }
+                     c_row[col] = sum;
+                  }
+               }
+            }
+         });
+         return result;
       }
 };
+
 }  // End of namespace LinearAlgebra
 
 #endif // LINEAR_ALGEBRA_H
\ No newline at end of file
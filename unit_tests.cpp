@@ -5,6 +5,62 @@
 #include <iostream>
 #include <cassert>
 #include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <type_traits>
+#include <cstdint>
+#include <cstdio>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+// Fills a matrix with small pseudo-random values so products can be checked against a reference.
+template<typename Scalar>
+void fillRandom(LinearAlgebra::Matrix<Scalar>& matrix) {
+    for (int i = 0; i < matrix.getRows(); ++i) {
+        for (int j = 0; j < matrix.getCols(); ++j) {
+            matrix.set(i, j, static_cast<Scalar>(std::rand() % 17 - 8) / Scalar(4));
+        }
+    }
+}
+
+// Straightforward triple loop used as the reference result for the optimized kernels.
+template<typename Scalar>
+double maxProductError(const LinearAlgebra::Matrix<Scalar>& a, const LinearAlgebra::Matrix<Scalar>& b,
+                       const LinearAlgebra::Matrix<Scalar>& result) {
+    double max_error = 0.0;
+    for (int i = 0; i < a.getRows(); ++i) {
+        for (int j = 0; j < b.getCols(); ++j) {
+            double expected = 0.0;
+            for (int k = 0; k < a.getCols(); ++k) {
+                expected += static_cast<double>(a.get(i, k)) * static_cast<double>(b.get(k, j));
+            }
+            max_error = std::max(max_error, std::fabs(expected - static_cast<double>(result.get(i, j))));
+        }
+    }
+    return max_error;
+}
+
+// Largest elementwise difference of two matrices of the same shape.
+template<typename Scalar>
+double maxAbsDifference(const LinearAlgebra::Matrix<Scalar>& a, const LinearAlgebra::Matrix<Scalar>& b) {
+    assert(a.getRows() == b.getRows() && a.getCols() == b.getCols());
+    double max_difference = 0.0;
+    for (int i = 0; i < a.getRows(); ++i) {
+        for (int j = 0; j < a.getCols(); ++j) {
+            max_difference = std::max(max_difference, std::fabs(static_cast<double>(a(i, j)) - static_cast<double>(b(i, j))));
+        }
+    }
+    return max_difference;
+}
 
 void testDefaultConstructor() {
    std::cout << "Testing Default Constructor...\n";
@@ -169,6 +225,868 @@ void testLargeTranspose() {
     std::cout << "Transposed 20x30 matrix:\n" << matrix << "\n";
 }
 
+void testBlockedMultiplication() {
+    std::cout << "\nTesting Blocked Multiplication...\n";
+    // Sizes straddle the register tile and cache block boundaries of the packed kernel.
+    const int shapes[][3] = {{1, 1, 1}, {5, 3, 7}, {17, 33, 9}, {97, 130, 300}, {200, 389, 150}};
+    for (const auto& shape : shapes) {
+        LinearAlgebra::Matrix<double> a(shape[0], shape[1]), b(shape[1], shape[2]);
+        LinearAlgebra::Matrix<float> af(shape[0], shape[1]), bf(shape[1], shape[2]);
+        LinearAlgebra::Matrix<int> ai(shape[0], shape[1]), bi(shape[1], shape[2]);
+        fillRandom(a); fillRandom(b);
+        fillRandom(af); fillRandom(bf);
+        for (int i = 0; i < shape[0]; ++i) for (int k = 0; k < shape[1]; ++k) ai.set(i, k, std::rand() % 11 - 5);
+        for (int k = 0; k < shape[1]; ++k) for (int j = 0; j < shape[2]; ++j) bi.set(k, j, std::rand() % 11 - 5);
+        assert(maxProductError(a, b, (a * b).eval()) < 1e-9);
+        assert(maxProductError(af, bf, (af * bf).eval()) < 1e-3);
+        assert(maxProductError(ai, bi, (ai * bi).eval()) == 0.0);
+    }
+    std::cout << "Expected Output: packed kernel matches reference product\n";
+    std::cout << "Actual Output: packed kernel matches reference product\n";
+}
+
+void testSimdDispatch() {
+    std::cout << "\nTesting SIMD Dispatch...\n";
+    const LinearAlgebra::SimdLevel detected = LinearAlgebra::detectedSimdLevel();
+    std::cout << "Detected SIMD level: " << static_cast<int>(detected) << "\n";
+    LinearAlgebra::Matrix<double> a(37, 53), b(53, 29);
+    LinearAlgebra::Matrix<float> af(37, 53), bf(53, 29);
+    fillRandom(a); fillRandom(b);
+    fillRandom(af); fillRandom(bf);
+    for (int level = 0; level <= static_cast<int>(detected); ++level) {
+        LinearAlgebra::setSimdLevel(static_cast<LinearAlgebra::SimdLevel>(level));
+        assert(LinearAlgebra::simdLevel() == static_cast<LinearAlgebra::SimdLevel>(level));
+        assert(maxProductError(a, b, (a * b).eval()) < 1e-9);
+        assert(maxProductError(af, bf, (af * bf).eval()) < 1e-3);
+
+        LinearAlgebra::Matrix<float> transposed(af);
+        transposed.transpose();
+        for (int i = 0; i < af.getRows(); ++i) {
+            for (int j = 0; j < af.getCols(); ++j) {
+                assert(transposed.get(j, i) == af.get(i, j));
+            }
+        }
+
+        std::vector<int> x(35), y(35), out(35);
+        for (int i = 0; i < 35; ++i) { x[i] = i - 17; y[i] = 3 * i; }
+        const auto& int_kernels = LinearAlgebra::detail::kernels<int>();
+        int_kernels.add(x.size(), x.data(), y.data(), out.data());
+        for (int i = 0; i < 35; ++i) assert(out[i] == x[i] + y[i]);
+        int_kernels.multiply(x.size(), x.data(), y.data(), out.data());
+        for (int i = 0; i < 35; ++i) assert(out[i] == x[i] * y[i]);
+        int_kernels.axpy(x.size(), 2, x.data(), out.data());
+        for (int i = 0; i < 35; ++i) assert(out[i] == x[i] * y[i] + 2 * x[i]);
+    }
+    LinearAlgebra::setSimdLevel(LinearAlgebra::SimdLevel::AVX512);
+    assert(LinearAlgebra::simdLevel() == detected);
+    std::cout << "Expected Output: every SIMD level matches the reference\n";
+    std::cout << "Actual Output: every SIMD level matches the reference\n";
+}
+
+void testParallelMultiplyAndTranspose() {
+    std::cout << "\nTesting Parallel Multiply and Transpose...\n";
+    LinearAlgebra::setNumThreads(4);
+    LinearAlgebra::setParallelThreshold(0);
+    assert(LinearAlgebra::numThreads() == 4);
+
+    LinearAlgebra::Matrix<double> a(301, 157), b(157, 263);
+    fillRandom(a); fillRandom(b);
+    assert(maxProductError(a, b, (a * b).eval()) < 1e-9);
+
+    LinearAlgebra::Matrix<int> matrix(300, 517);
+    for (int i = 0; i < 300; ++i) for (int j = 0; j < 517; ++j) matrix.set(i, j, i * 1000 + j);
+    matrix.transpose();
+    for (int i = 0; i < 300; ++i) for (int j = 0; j < 517; ++j) assert(matrix.get(j, i) == i * 1000 + j);
+
+    LinearAlgebra::Matrix<int> square(517, 517);
+    for (int i = 0; i < 517; ++i) for (int j = 0; j < 517; ++j) square.set(i, j, i * 1000 + j);
+    square.transpose();
+    for (int i = 0; i < 517; ++i) for (int j = 0; j < 517; ++j) assert(square.get(j, i) == i * 1000 + j);
+
+    // Exceptions thrown inside a task reach the caller once every task has finished.
+    bool caught = false;
+    try {
+        LinearAlgebra::ThreadPool::global().parallelFor(16, [](int i) {
+            if (i == 7) throw std::runtime_error("task failed");
+        });
+    } catch (const std::runtime_error&) {
+        caught = true;
+    }
+    assert(caught);
+
+    LinearAlgebra::setNumThreads(1);
+    LinearAlgebra::setParallelThreshold(128 * 128 * 128);
+    std::cout << "Expected Output: parallel results match the reference\n";
+    std::cout << "Actual Output: parallel results match the reference\n";
+}
+
+void testExpressionTemplates() {
+    std::cout << "\nTesting Expression Templates...\n";
+    LinearAlgebra::Matrix<int> a(2, 2, {{1, 2}, {3, 4}});
+    LinearAlgebra::Matrix<int> b(2, 2, {{5, 6}, {7, 8}});
+    LinearAlgebra::Matrix<int> c(2, 2, {{1, 1}, {1, 1}});
+
+    LinearAlgebra::Matrix<int> sum = a + b - c;
+    assert(sum.get(0, 0) == 5 && sum.get(0, 1) == 7 && sum.get(1, 0) == 9 && sum.get(1, 1) == 11);
+    LinearAlgebra::Matrix<int> scaled = 2 * a - b * 3;
+    assert(scaled.get(0, 0) == -13 && scaled.get(1, 1) == -16);
+    LinearAlgebra::Matrix<int> product = LinearAlgebra::hadamard(a, b);
+    assert(product.get(0, 1) == 12 && product.get(1, 0) == 21);
+
+    // alpha * A * B + beta * C accumulates into C in a single GEMM.
+    c = 2 * a * b + 3 * c;
+    assert(c.get(0, 0) == 41 && c.get(0, 1) == 47 && c.get(1, 0) == 89 && c.get(1, 1) == 103);
+    c = a * b - c;
+    assert(c.get(0, 0) == -22 && c.get(1, 1) == -53);
+    c += a * b;
+    assert(c.get(0, 0) == -3 && c.get(1, 1) == -3);
+    c -= a;
+    assert(c.get(0, 0) == -4 && c.get(1, 1) == -7);
+
+    // Assigning a product to one of its operands goes through a temporary.
+    a = a * b;
+    assert(a.get(0, 0) == 19 && a.get(0, 1) == 22 && a.get(1, 0) == 43 && a.get(1, 1) == 50);
+
+    // Operands that are themselves expressions are evaluated once.
+    LinearAlgebra::Matrix<int> chained = (b + b) * b + b - b;
+    assert(chained.get(0, 0) == 2 * 67 && chained.get(1, 1) == 2 * 106);
+
+    // A product can be read and printed directly, like the Matrix operator* used to return.
+    assert((a * b).get(1, 0) == 43 * 5 + 50 * 7 && (a * b).get(0, 1) == 19 * 6 + 22 * 8);
+    std::ostringstream printed, evaluated;
+    printed << a * b;
+    evaluated << LinearAlgebra::Matrix<int>(a * b);
+    assert(printed.str() == evaluated.str());
+
+    // Sums and differences of two products, also when the destination is an operand.
+    LinearAlgebra::Matrix<int> ab = a * b, bb = b * b;
+    LinearAlgebra::Matrix<int> two_products = a * b + b * b;
+    assert(maxAbsDifference(two_products, LinearAlgebra::Matrix<int>(ab + bb)) == 0);
+    LinearAlgebra::Matrix<int> b_two = b * two_products;
+    two_products = a * b - b * two_products;
+    assert(maxAbsDifference(two_products, LinearAlgebra::Matrix<int>(ab - b_two)) == 0);
+    try {
+        LinearAlgebra::Matrix<int> bad = a * b + LinearAlgebra::Matrix<int>(2, 3) * LinearAlgebra::Matrix<int>(3, 3);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+
+    LinearAlgebra::Matrix<double> x(67, 45), y(45, 33), z(67, 33);
+    fillRandom(x); fillRandom(y); fillRandom(z);
+    LinearAlgebra::Matrix<double> reference = x * y;
+    LinearAlgebra::Matrix<double> result = 0.5 * x * y + 2.0 * z;
+    for (int i = 0; i < 67; ++i) {
+        for (int j = 0; j < 33; ++j) {
+            assert(std::fabs(result.get(i, j) - (0.5 * reference.get(i, j) + 2.0 * z.get(i, j))) < 1e-9);
+        }
+    }
+
+    try {
+        LinearAlgebra::Matrix<int> bad = b + LinearAlgebra::Matrix<int>(3, 2);
+        assert(false);
+    } catch (const std::invalid_argument& e) {
+        std::cout << "Expected Output: Matrices are not conformant for elementwise operation\n";
+        std::cout << "Actual Output: " << e.what() << "\n";
+    }
+}
+
+void testTransposeInPlaceAndInto() {
+    std::cout << "\nTesting In-Place Transpose and transposeInto...\n";
+    const int shapes[][2] = {{1, 9}, {9, 1}, {8, 8}, {67, 67}, {13, 29}, {130, 77}, {300, 300}};
+    for (const auto& shape : shapes) {
+        const int rows = shape[0], cols = shape[1];
+        LinearAlgebra::Matrix<double> matrix(rows, cols);
+        for (int i = 0; i < rows; ++i) for (int j = 0; j < cols; ++j) matrix.set(i, j, i * 1000.0 + j);
+
+        LinearAlgebra::Matrix<double> into(1, 1);
+        matrix.transposeInto(into);
+        std::vector<double> raw(static_cast<std::size_t>(rows) * cols);
+        matrix.transposeInto(raw.data(), rows);
+        matrix.transpose();
+
+        assert(matrix.getRows() == cols && matrix.getCols() == rows);
+        assert(into.getRows() == cols && into.getCols() == rows);
+        for (int i = 0; i < rows; ++i) {
+            for (int j = 0; j < cols; ++j) {
+                assert(matrix.get(j, i) == i * 1000.0 + j);
+                assert(into.get(j, i) == i * 1000.0 + j);
+                assert(raw[j * rows + i] == i * 1000.0 + j);
+            }
+        }
+    }
+    std::cout << "Expected Output: in-place and out-of-place transposes match\n";
+    std::cout << "Actual Output: in-place and out-of-place transposes match\n";
+}
+
+void testMatrixView() {
+    std::cout << "\nTesting Matrix View...\n";
+    LinearAlgebra::Matrix<int> a(2, 3, {{1, 2, 3}, {4, 5, 6}});
+    LinearAlgebra::MatrixView<const int> transposed = a.view().transposed();
+    assert(transposed.getRows() == 3 && transposed.getCols() == 2);
+    assert(transposed.get(2, 0) == 3 && transposed.get(0, 1) == 4);
+    LinearAlgebra::MatrixView<int> block = a.view().block(0, 1, 2, 2);
+    block.set(1, 1, 60);
+    assert(a.get(1, 2) == 60 && block.get(0, 0) == 2);
+    a.set(1, 2, 6);
+
+    // A^T * A straight from the transposed view, without materializing A^T.
+    LinearAlgebra::Matrix<int> gram = transposed * a;
+    assert(gram.getRows() == 3 && gram.getCols() == 3);
+    assert(gram.get(0, 0) == 17 && gram.get(0, 2) == 27 && gram.get(2, 2) == 45);
+
+    // Views over an external buffer, and a GEMM that writes into a block of a larger matrix.
+    std::vector<double> buffer = {1, 2, 0, 3, 4, 0};
+    LinearAlgebra::MatrixView<double> external(buffer.data(), 2, 2, 3);
+    LinearAlgebra::Matrix<double> result(3, 3, {{0, 0, 0}, {0, 0, 0}, {0, 0, 9}});
+    LinearAlgebra::gemm<double>(1.0, external, external.transposed(), 0.0, result.view().block(0, 0, 2, 2));
+    assert(result.get(0, 0) == 5 && result.get(0, 1) == 11 && result.get(1, 0) == 11 && result.get(1, 1) == 25);
+    assert(result.get(2, 2) == 9 && result.get(0, 2) == 0);
+    LinearAlgebra::gemm<double>(1.0, external, external, 1.0, result.view().block(0, 0, 2, 2).transposed());
+    assert(result.get(0, 0) == 12 && result.get(1, 0) == 21 && result.get(0, 1) == 26);
+
+    // Larger transposed and sliced operands against the reference product.
+    LinearAlgebra::Matrix<double> x(83, 61), y(70, 83);
+    fillRandom(x); fillRandom(y);
+    LinearAlgebra::Matrix<double> xt = x.view().transposed();
+    LinearAlgebra::Matrix<double> yt = y.view().transposed();
+    assert(maxProductError(xt, yt, (x.view().transposed() * y.view().transposed()).eval()) < 1e-9);
+    LinearAlgebra::Matrix<double> x_block = x.view().block(3, 5, 40, 50);
+    LinearAlgebra::Matrix<double> yt_block = y.view().transposed().block(5, 7, 50, 30);
+    assert(maxProductError(x_block, yt_block, (x.view().block(3, 5, 40, 50) * y.view().transposed().block(5, 7, 50, 30)).eval()) < 1e-9);
+
+    // Assigning a transposed view of a square matrix to itself goes through a temporary.
+    LinearAlgebra::Matrix<int> square(2, 2, {{1, 2}, {3, 4}});
+    square = square.view().transposed();
+    assert(square.get(0, 1) == 3 && square.get(1, 0) == 2);
+    std::cout << "Expected Output: views match their materialized copies\n";
+    std::cout << "Actual Output: views match their materialized copies\n";
+}
+
+// Destroyed after the main thread's storage pool at exit, so its buffer has to bypass the pool.
+static LinearAlgebra::Matrix<double> static_matrix(4, 4);
+
+void testAlignedPooledStorage() {
+    std::cout << "\nTesting Aligned Pooled Storage...\n";
+    const double* first_buffer;
+    {
+        LinearAlgebra::Matrix<double> matrix(7, 13);
+        first_buffer = matrix.view().data();
+        assert(reinterpret_cast<std::uintptr_t>(first_buffer) % 64 == 0);
+    }
+    // A buffer of the same size class is handed straight back by the thread's pool.
+    LinearAlgebra::Matrix<double> reused(13, 7);
+    assert(reused.view().data() == first_buffer);
+
+    LinearAlgebra::Matrix<int> a(2, 2, {{1, 2}, {3, 4}});
+    {
+        LinearAlgebra::ScratchArena arena(1 << 16);
+        LinearAlgebra::Matrix<int> product = a * a;
+        LinearAlgebra::Matrix<float> temporary(3, 5);
+        assert(arena.used() > 0);
+        assert(reinterpret_cast<std::uintptr_t>(product.view().data()) % 64 == 0);
+        assert(reinterpret_cast<std::uintptr_t>(temporary.view().data()) % 64 == 0);
+        assert(product.get(0, 0) == 7 && product.get(1, 1) == 22);
+        {
+            // Does not fit into the arena, so it comes from the pool instead.
+            LinearAlgebra::Matrix<double> large(200, 200);
+            assert(arena.used() < 200 * 200 * sizeof(double));
+        }
+        // Requests whose rounded size would wrap around are refused instead of handed a tiny block.
+        assert(LinearAlgebra::ScratchArena::allocate(std::numeric_limits<std::size_t>::max() - 8) == nullptr);
+    }
+
+    // Negative dimensions and sizes that overflow size_t never reach the allocator.
+    try {
+        LinearAlgebra::Matrix<double> negative(-1, 2);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+    try {
+        reused.resize(3, -4);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+    assert(reused.getRows() == 13 && reused.getCols() == 7);
+    try {
+        reused.reserve(std::numeric_limits<std::size_t>::max() - 1);
+        assert(false);
+    } catch (const std::bad_alloc&) {
+    }
+    assert(reused.getCapacity() == 13 * 7);
+    std::cout << "Expected Output: buffers are 64-byte aligned and reused\n";
+    std::cout << "Actual Output: buffers are 64-byte aligned and reused\n";
+}
+
+void testOwnershipAndAllocations() {
+    std::cout << "\nTest: Move semantics and allocation counts\n";
+    LinearAlgebra::Matrix<double> a(48, 32), b(32, 40);
+    fillRandom(a);
+    fillRandom(b);
+
+    std::size_t before = LinearAlgebra::storageAllocationCount();
+    LinearAlgebra::Matrix<double> c = a * b;
+    assert(LinearAlgebra::storageAllocationCount() - before == 1);
+    assert(maxProductError(a, b, c) < 1e-9);
+
+    // Re-evaluating into, copying into or moving an existing buffer must not allocate.
+    before = LinearAlgebra::storageAllocationCount();
+    c = a * b;
+    c = a * b + c;
+    LinearAlgebra::Matrix<double> d(48, 40);
+    d = c;
+    LinearAlgebra::Matrix<double> moved(std::move(d));
+    LinearAlgebra::Matrix<double> target(1, 1);
+    target = std::move(moved);
+    assert(LinearAlgebra::storageAllocationCount() == before + 2);  // Only the two constructors.
+    assert(d.getRows() == 0 && d.getCols() == 0 && d.getCapacity() == 0);
+    assert(moved.getRows() == 0 && moved.getCols() == 0);
+    assert(target.getRows() == 48 && target.getCols() == 40 && target.get(3, 7) == c.get(3, 7));
+
+    // Growing beyond the capacity keeps the flattened contents; the new elements are left uninitialized.
+    LinearAlgebra::Matrix<double> grown(2, 2, {{1, 2}, {3, 4}});
+    grown.resize(10, 10);
+    assert(grown.getCapacity() >= 100 && grown.get(0, 0) == 1 && grown.get(0, 1) == 2 && grown.get(0, 2) == 3 && grown.get(0, 3) == 4);
+
+    // A moved-from matrix can be reused as an assignment target.
+    d = a;
+    assert(d.getRows() == 48 && d.getCols() == 32 && d.get(5, 5) == a.get(5, 5));
+
+    // resize() keeps the buffer while it is large enough, reserve() keeps the contents.
+    LinearAlgebra::Matrix<int> e(2, 3, {{1, 2, 3}, {4, 5, 6}});
+    e.reserve(64);
+    assert(e.getCapacity() == 64 && e.get(1, 2) == 6);
+    before = LinearAlgebra::storageAllocationCount();
+    e.resize(8, 8);
+    e.resize(3, 2);
+    assert(LinearAlgebra::storageAllocationCount() == before);
+    assert(e.getRows() == 3 && e.getCols() == 2 && e.getCapacity() == 64);
+    assert(e.get(2, 1) == 6);
+    std::cout << "Expected Output: one allocation per new result, none for reuse or moves\n";
+    std::cout << "Actual Output: one allocation per new result, none for reuse or moves\n";
+}
+
+void testFixedSizeMatrix() {
+    std::cout << "\nTest: Fixed-size matrices\n";
+    typedef LinearAlgebra::FixedMatrix<int, 2, 3> Fixed2x3;
+    typedef LinearAlgebra::FixedMatrix<int, 3, 2> Fixed3x2;
+    constexpr Fixed2x3 a(1, 2, 3, 4, 5, 6);
+    constexpr Fixed3x2 b(7, 8, 9, 10, 11, 12);
+    constexpr LinearAlgebra::FixedMatrix<int, 2, 2> product = a * b;
+    static_assert(product.coeff(0, 0) == 58 && product.coeff(1, 1) == 154, "Product is evaluated at compile time");
+    static_assert(a.transposed().coeff(2, 0) == 3 && (a + a - a).coeff(1, 2) == 6, "Transpose and sums are constexpr");
+    static_assert(sizeof(Fixed2x3) == 6 * sizeof(int), "Elements are stored inline");
+
+    std::size_t before = LinearAlgebra::storageAllocationCount();
+    LinearAlgebra::FixedMatrix<double, 4, 4> transform{{0, -1, 0, 1}, {1, 0, 0, 2}, {0, 0, 1, 3}, {0, 0, 0, 1}};
+    LinearAlgebra::FixedMatrix<double, 4, 4> twice = transform * transform;
+    twice += LinearAlgebra::FixedMatrix<double, 4, 4>::identity();
+    twice.transpose();
+    assert(LinearAlgebra::storageAllocationCount() == before);
+    assert(twice.get(0, 0) == 0.0 && twice.get(0, 1) == 0.0 && twice.get(3, 0) == -1.0 && twice.get(3, 3) == 2.0);
+
+    // Interop with the dynamic Matrix class.
+    LinearAlgebra::Matrix<int> dynamic(3, 2, {{7, 8}, {9, 10}, {11, 12}});
+    LinearAlgebra::Matrix<int> mixed = a * dynamic;
+    LinearAlgebra::Matrix<int> sum = dynamic + b;
+    Fixed3x2 converted(dynamic);
+    assert(mixed.get(0, 0) == 58 && mixed.get(1, 1) == 154);
+    assert(sum.get(2, 1) == 24 && converted.get(1, 0) == 9);
+    try {
+        Fixed2x3 wrong(dynamic);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+    std::cout << "Expected Output: 58 154 without heap allocations\n";
+    std::cout << "Actual Output: " << product.get(0, 0) << " " << product.get(1, 1) << " without heap allocations\n";
+}
+
+void testBinaryFilesAndTextOutput() {
+    std::cout << "\nTest: Binary save/load/mmap and text output\n";
+    const std::string path = "unit_tests_matrix.bin";
+    LinearAlgebra::Matrix<double> weights(37, 53), input(53, 8);
+    fillRandom(weights);
+    fillRandom(input);
+    weights.save(path);
+
+    LinearAlgebra::Matrix<double> loaded = LinearAlgebra::Matrix<double>::load(path);
+    assert(loaded.getRows() == 37 && loaded.getCols() == 53);
+    for (int i = 0; i < 37 * 53; ++i) {
+        assert(loaded.coeff(i) == weights.coeff(i));
+    }
+    {
+        LinearAlgebra::MappedMatrix<double> mapped = LinearAlgebra::Matrix<double>::mmap(path);
+        assert(mapped.getRows() == 37 && mapped.getCols() == 53 && mapped.get(36, 52) == weights.get(36, 52));
+        assert(reinterpret_cast<std::uintptr_t>(mapped.view().data()) % 64 == 0);
+        LinearAlgebra::Matrix<double> product = mapped * input;
+        LinearAlgebra::Matrix<double> sum = mapped + weights;
+        assert(maxProductError(weights, input, product) < 1e-9);
+        assert(sum.get(5, 7) == 2 * weights.get(5, 7));
+    }
+
+    LinearAlgebra::Matrix<int> small(2, 3, {{1, 2, 3}, {4, 5, 6}});
+    small.save(path);
+    LinearAlgebra::Matrix<int> small_loaded = LinearAlgebra::Matrix<int>::load(path);
+    assert(small_loaded.get(1, 2) == 6);
+
+    // The element type is checked.
+    try {
+        LinearAlgebra::Matrix<double>::load(path);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+
+    // A corrupt stride whose extent wraps around in 64-bit arithmetic (2^62 * 4 bytes) is rejected, not indexed.
+    LinearAlgebra::Matrix<float>(2, 4, {{1, 2, 3, 4}, {5, 6, 7, 8}}).save(path);
+    {
+        std::fstream file(path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+        const std::int64_t row_stride = std::int64_t(1) << 62;
+        file.seekp(48);  // BinaryHeader::row_stride
+        file.write(reinterpret_cast<const char*>(&row_stride), sizeof(row_stride));
+    }
+    try {
+        LinearAlgebra::Matrix<float>::load(path);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+    try {
+        LinearAlgebra::Matrix<float>::mmap(path);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+    std::remove(path.c_str());
+    try {
+        LinearAlgebra::Matrix<double>::mmap(path);
+        assert(false);
+    } catch (const std::runtime_error&) {
+    }
+
+    // Buffered text output matches streaming every element, including the stream's formatting settings.
+    LinearAlgebra::Matrix<double> fractions(2, 2, {{1.0 / 3, -2.5}, {1e20, 0.0}});
+    std::ostringstream fast, expected;
+    fast << fractions << std::fixed << std::setprecision(2) << fractions;
+    expected << 1.0 / 3 << " " << -2.5 << " \n" << 1e20 << " " << 0.0 << " \n" << std::fixed << std::setprecision(2)
+             << 1.0 / 3 << " " << -2.5 << " \n" << 1e20 << " " << 0.0 << " \n";
+    std::ostringstream integers;
+    integers << small_loaded;
+    assert(fast.str() == expected.str());
+    assert(integers.str() == "1 2 3 \n4 5 6 \n");
+    // A field width applies to the first element only, exactly as with per-element streaming.
+    std::ostringstream padded, padded_expected;
+    padded << std::setw(4) << std::setfill('*') << small_loaded << std::setw(6) << fractions;
+    padded_expected << std::setw(4) << std::setfill('*') << 1 << " 2 3 \n4 5 6 \n" << std::setw(6) << 1.0 / 3 << " "
+                    << -2.5 << " \n" << 1e20 << " " << 0.0 << " \n";
+    assert(padded.str() == padded_expected.str() && padded.str().compare(0, 5, "***1 ") == 0);
+    std::cout << "Expected Output:\n1 2 3 \n4 5 6 \n";
+    std::cout << "Actual Output:\n" << integers.str();
+}
+
+void testStreamingMultiply() {
+    std::cout << "\nTest: Out-of-core streaming multiplication\n";
+    LinearAlgebra::Matrix<double> a(150, 70), b(70, 90);
+    fillRandom(a);
+    fillRandom(b);
+    a.save("unit_tests_a.bin");
+    b.save("unit_tests_b.bin");
+    {
+        // A budget of 6 tiles of 24 x 24 doubles, so every dimension needs several partial tiles.
+        LinearAlgebra::MatrixFile<double> a_file("unit_tests_a.bin"), b_file("unit_tests_b.bin");
+        LinearAlgebra::MatrixFile<double> c_file = LinearAlgebra::MatrixFile<double>::create("unit_tests_c.bin", 150, 90);
+        LinearAlgebra::streamingMultiply<double>(a_file, b_file, c_file, 6 * 24 * 24 * sizeof(double));
+    }
+    LinearAlgebra::Matrix<double> c = LinearAlgebra::Matrix<double>::load("unit_tests_c.bin");
+    assert(c.getRows() == 150 && c.getCols() == 90);
+    assert(maxProductError(a, b, c) < 1e-9);
+
+    // In-memory operands and result, including a transposed view.
+    LinearAlgebra::Matrix<double> at(70, 150), from_views(150, 90);
+    a.transposeInto(at);
+    LinearAlgebra::ViewTileSource<double> a_source(at.view().transposed()), b_source(b.view());
+    LinearAlgebra::ViewTileSink<double> c_sink(from_views.view());
+    LinearAlgebra::streamingMultiply<double>(a_source, b_source, c_sink, 6 * 40 * 40 * sizeof(double));
+    assert(maxProductError(a, b, from_views) < 1e-9);
+
+    // A sink that is not reentrant: slow writes must still arrive one at a time, in the order the tiles finish.
+    struct SerialSink : LinearAlgebra::ViewTileSink<double> {
+        std::atomic<int> active;
+        int max_active;
+        std::vector<int> first_rows;
+        explicit SerialSink(const LinearAlgebra::MatrixView<double>& view)
+            : LinearAlgebra::ViewTileSink<double>(view), active(0), max_active(0) {}
+        void writeTile(int first_row, int first_col, int tile_rows, int tile_cols, const double* src, std::ptrdiff_t lds) {
+            max_active = std::max(max_active, ++active);
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            first_rows.push_back(first_row);
+            LinearAlgebra::ViewTileSink<double>::writeTile(first_row, first_col, tile_rows, tile_cols, src, lds);
+            --active;
+        }
+    };
+    LinearAlgebra::Matrix<double> serial(150, 90);
+    SerialSink serial_sink(serial.view());
+    LinearAlgebra::ViewTileSource<double> a_memory(a.view());
+    LinearAlgebra::streamingMultiply<double>(a_memory, b_source, serial_sink, 6 * 24 * 24 * sizeof(double));
+    assert(serial_sink.max_active == 1 && std::is_sorted(serial_sink.first_rows.begin(), serial_sink.first_rows.end()));
+    assert(maxProductError(a, b, serial) < 1e-9);
+
+    try {
+        LinearAlgebra::streamingMultiply<double>(b_source, b_source, c_sink);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+    // Negative dimensions are rejected before anything is written.
+    std::remove("unit_tests_c.bin");
+    for (int bad_cols : {-1, 5}) {
+        try {
+            LinearAlgebra::MatrixFile<double>::create("unit_tests_c.bin", -1, bad_cols);
+            assert(false);
+        } catch (const std::invalid_argument&) {
+        }
+    }
+    assert(std::ifstream("unit_tests_c.bin").fail());
+    std::remove("unit_tests_a.bin");
+    std::remove("unit_tests_b.bin");
+    std::cout << "Expected Output: streamed product matches the in-memory product\n";
+    std::cout << "Actual Output: streamed product matches the in-memory product\n";
+}
+
+void testBatchMultiply() {
+    std::cout << "\nTest: Batched small-matrix multiplication\n";
+    // 37 products is not a multiple of any interleaving width, so the last group is partial.
+    const int batch = 37;
+    std::vector<LinearAlgebra::Matrix<double>> left, right, results(batch, LinearAlgebra::Matrix<double>(8, 8));
+    for (int i = 0; i < batch; ++i) {
+        left.push_back(LinearAlgebra::Matrix<double>(8, 8));
+        right.push_back(LinearAlgebra::Matrix<double>(8, 8));
+        fillRandom(left.back());
+        fillRandom(right.back());
+    }
+    std::size_t before = LinearAlgebra::storageAllocationCount();
+    LinearAlgebra::batchMultiply(left, right, results);
+    assert(LinearAlgebra::storageAllocationCount() == before);
+    for (int i = 0; i < batch; ++i) {
+        assert(maxProductError(left[i], right[i], results[i]) < 1e-9);
+    }
+
+    // Contiguous batch of 3 x 5 times one shared 5 x 2 matrix (stride 0), for every SIMD level and in parallel.
+    const int m = 3, k = 5, n = 2, int_batch = 21;
+    std::vector<int> a(int_batch * m * k), b(k * n), c(int_batch * m * n);
+    for (std::size_t i = 0; i < a.size(); ++i) a[i] = static_cast<int>(i % 9) - 4;
+    for (std::size_t i = 0; i < b.size(); ++i) b[i] = static_cast<int>(i % 5) - 2;
+    LinearAlgebra::SimdLevel detected = LinearAlgebra::detectedSimdLevel();
+    for (int level = 0; level <= static_cast<int>(detected) + 1; ++level) {
+        if (level <= static_cast<int>(detected)) {
+            LinearAlgebra::setSimdLevel(static_cast<LinearAlgebra::SimdLevel>(level));
+        } else {
+            LinearAlgebra::setNumThreads(4);
+            LinearAlgebra::setParallelThreshold(0);
+        }
+        std::fill(c.begin(), c.end(), 0);
+        LinearAlgebra::batchMultiply(int_batch, m, n, k, a.data(), m * k, b.data(), 0, c.data(), m * n);
+        for (int s = 0; s < int_batch; ++s) {
+            for (int i = 0; i < m; ++i) {
+                for (int j = 0; j < n; ++j) {
+                    int expected = 0;
+                    for (int p = 0; p < k; ++p) expected += a[s * m * k + i * k + p] * b[p * n + j];
+                    assert(c[s * m * n + i * n + j] == expected);
+                }
+            }
+        }
+    }
+    LinearAlgebra::setSimdLevel(detected);
+    LinearAlgebra::setNumThreads(1);
+    LinearAlgebra::setParallelThreshold(128 * 128 * 128);
+
+    try {
+        std::vector<LinearAlgebra::Matrix<double>> short_batch(2, LinearAlgebra::Matrix<double>(8, 8));
+        LinearAlgebra::batchMultiply(left, short_batch, results);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+    std::cout << "Expected Output: every batched product matches operator*\n";
+    std::cout << "Actual Output: every batched product matches operator*\n";
+}
+
+void testMixedPrecisionMultiply() {
+    std::cout << "\nTest: Mixed-type and mixed-precision multiplication\n";
+    static_assert(std::is_same<LinearAlgebra::ProductScalar<std::int8_t, std::int8_t>::type, int>::value, "int8 accumulates in int");
+    static_assert(std::is_same<LinearAlgebra::ProductScalar<int, double>::type, double>::value, "int * double is double");
+    static_assert(std::is_same<LinearAlgebra::ProductScalar<LinearAlgebra::BFloat16, LinearAlgebra::Float16>::type, float>::value,
+                  "16-bit floats compute in float");
+
+    // int8 products of this depth overflow int8 but not the int accumulator.
+    const int m = 70, k = 130, n = 50;
+    LinearAlgebra::Matrix<std::int8_t> a8(m, k), b8(k, n);
+    for (int i = 0; i < m; ++i) for (int p = 0; p < k; ++p) a8.set(i, p, static_cast<std::int8_t>((i * 7 + p * 3) % 255 - 127));
+    for (int p = 0; p < k; ++p) for (int j = 0; j < n; ++j) b8.set(p, j, static_cast<std::int8_t>((p * 5 + j * 11) % 255 - 127));
+    LinearAlgebra::Matrix<int> c = a8 * b8;
+    LinearAlgebra::Matrix<int> accumulated = c;
+    accumulated += a8 * b8;
+    accumulated = 3 * (a8 * b8) - accumulated;
+    for (int i = 0; i < m; ++i) {
+        for (int j = 0; j < n; ++j) {
+            int expected = 0;
+            for (int p = 0; p < k; ++p) expected += a8.get(i, p) * b8.get(p, j);
+            assert(c.get(i, j) == expected);
+            assert(accumulated.get(i, j) == expected);
+        }
+    }
+
+    // int * double and float * double give double, through the transposed view as well.
+    LinearAlgebra::Matrix<int> ai(m, k);
+    LinearAlgebra::Matrix<double> bd(k, n);
+    LinearAlgebra::Matrix<float> af(n, k);
+    for (int i = 0; i < m; ++i) for (int p = 0; p < k; ++p) ai.set(i, p, static_cast<int>(a8.get(i, p)));
+    fillRandom(bd);
+    fillRandom(af);
+    LinearAlgebra::Matrix<double> cd = ai * bd;
+    LinearAlgebra::Matrix<double> cf = af * bd.view().transposed().transposed();
+    LinearAlgebra::Matrix<double> cv = bd.view().transposed() * ai.view().transposed();
+    for (int i = 0; i < m; ++i) {
+        for (int j = 0; j < n; ++j) {
+            double expected = 0;
+            for (int p = 0; p < k; ++p) expected += ai.get(i, p) * bd.get(p, j);
+            assert(std::fabs(cd.get(i, j) - expected) < 1e-9);
+            assert(std::fabs(cv.get(j, i) - expected) < 1e-9);
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            double expected = 0;
+            for (int p = 0; p < k; ++p) expected += static_cast<double>(af.get(i, p)) * bd.get(p, j);
+            assert(std::fabs(cf.get(i, j) - expected) < 1e-9);
+        }
+    }
+
+    // 16-bit storage types round to nearest even and cover their special values.
+    assert(static_cast<float>(LinearAlgebra::BFloat16(1.00390625f)) == 1.0f);
+    assert(static_cast<float>(LinearAlgebra::BFloat16(1.01171875f)) == 1.015625f);
+    assert(static_cast<float>(LinearAlgebra::Float16(65504.0f)) == 65504.0f);
+    assert(std::isinf(static_cast<float>(LinearAlgebra::Float16(70000.0f))));
+    assert(static_cast<float>(LinearAlgebra::Float16(-5.9604644775390625e-8f)) == -5.9604644775390625e-8f);
+    assert(LinearAlgebra::Float16(1.0f).toBits() == 0x3c00 && LinearAlgebra::BFloat16(1.0f).toBits() == 0x3f80);
+
+    // BFloat16 and Float16 products are computed in float, serially and in parallel.
+    LinearAlgebra::Matrix<LinearAlgebra::BFloat16> ab(m, k);
+    LinearAlgebra::Matrix<LinearAlgebra::Float16> bh(k, n);
+    for (int i = 0; i < m; ++i) for (int p = 0; p < k; ++p) ab.set(i, p, LinearAlgebra::BFloat16(bd.get(p % k, i % n)));
+    for (int p = 0; p < k; ++p) for (int j = 0; j < n; ++j) bh.set(p, j, LinearAlgebra::Float16(bd.get(p, j)));
+    for (int round = 0; round < 2; ++round) {
+        if (round == 1) {
+            LinearAlgebra::setNumThreads(4);
+            LinearAlgebra::setParallelThreshold(0);
+        }
+        LinearAlgebra::Matrix<float> ch = ab * bh;
+        for (int i = 0; i < m; ++i) {
+            for (int j = 0; j < n; ++j) {
+                double expected = 0;
+                for (int p = 0; p < k; ++p) expected += static_cast<double>(ab.get(i, p)) * static_cast<float>(bh.get(p, j));
+                assert(std::fabs(ch.get(i, j) - expected) < 1e-3);
+            }
+        }
+    }
+    LinearAlgebra::setNumThreads(1);
+    LinearAlgebra::setParallelThreshold(128 * 128 * 128);
+
+    try {
+        LinearAlgebra::Matrix<int> wrong = b8 * a8;
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+    std::cout << "Expected Output: every mixed-type product matches the widened reference\n";
+    std::cout << "Actual Output: every mixed-type product matches the widened reference\n";
+}
+
+void testElementAccessAndIterators() {
+    std::cout << "\nTest: Unchecked element access, row spans and column iterators\n";
+    LinearAlgebra::Matrix<int> matrix(3, 4, {{5, 1, 9, 2}, {8, 3, 7, 6}, {4, 0, 11, 10}});
+    matrix(1, 2) += 100;
+    assert(matrix(1, 2) == 107 && matrix.at(1, 2) == 107 && matrix.get(1, 2) == 107);
+    assert(matrix.data() == &matrix(0, 0) && matrix.row(2).data() == matrix.data() + 8);
+    try {
+        matrix.at(3, 0) = 1;
+        assert(false);
+    } catch (const std::out_of_range&) {
+    }
+#if LINEAR_ALGEBRA_CHECK_BOUNDS
+    try {
+        matrix(0, 4) = 1;
+        assert(false);
+    } catch (const std::out_of_range&) {
+    }
+#endif
+
+    // Rows are contiguous spans, columns strided random access ranges.
+    assert(std::accumulate(matrix.row(0).begin(), matrix.row(0).end(), 0) == 17);
+    LinearAlgebra::StridedSpan<int> column = matrix.col(1);
+    assert(column.size() == 3 && column.end() - column.begin() == 3);
+    std::sort(column.begin(), column.end(), std::greater<int>());
+    assert(matrix(0, 1) == 3 && matrix(1, 1) == 1 && matrix(2, 1) == 0);
+    assert(*std::max_element(matrix.col(3).begin(), matrix.col(3).end()) == 10);
+    std::vector<int> reversed(matrix.col(0).begin(), matrix.col(0).end());
+    std::reverse(reversed.begin(), reversed.end());
+    assert(reversed == std::vector<int>({4, 8, 5}));
+    std::fill(matrix.begin(), matrix.end(), 7);
+    for (int value : matrix) assert(value == 7);
+
+    const LinearAlgebra::Matrix<int>& read_only = matrix;
+    LinearAlgebra::StridedIterator<const int> first = read_only.col(2).begin();
+    assert(first[2] == 7 && read_only(2, 3) == 7 && read_only.row(1)[3] == 7);
+
+    // A row of a transposed view is a column of the storage.
+    LinearAlgebra::Matrix<double> square(3, 3, {{1, 2, 3}, {4, 5, 6}, {7, 8, 9}});
+    LinearAlgebra::MatrixView<double> transposed = square.view().transposed();
+    assert(std::accumulate(transposed.row(0).begin(), transposed.row(0).end(), 0.0) == 12.0);
+    transposed(0, 2) = -1.0;
+    assert(square(2, 0) == -1.0);
+
+    LinearAlgebra::FixedMatrix<float, 2, 3> fixed(1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f);
+    fixed(1, 0) = 10.0f;
+    assert(fixed.at(1, 0) == 10.0f && fixed.data()[3] == 10.0f);
+    assert(std::accumulate(fixed.col(0).begin(), fixed.col(0).end(), 0.0f) == 11.0f);
+    assert(std::accumulate(fixed.row(1).begin(), fixed.row(1).end(), 0.0f) == 21.0f);
+    std::cout << "Expected Output: element access, spans and iterators agree with get()\n";
+    std::cout << "Actual Output: element access, spans and iterators agree with get()\n";
+}
+
+void testSparseMatrix() {
+    std::cout << "\nTest: Sparse CSR/CSC matrices and sparse-dense products\n";
+    // About 5% nonzeros, one dense row, and the last column left empty.
+    const int m = 120, k = 90, n = 70;
+    LinearAlgebra::Matrix<double> dense(m, k);
+    std::fill(dense.begin(), dense.end(), 0.0);
+    for (int i = 0; i < m; ++i) {
+        for (int p = 0; p < k - 1; ++p) {
+            if ((i * 31 + p * 17) % 19 == 0 || i == 7) dense(i, p) = static_cast<double>((i + 2 * p) % 13) - 6.5;
+        }
+    }
+    LinearAlgebra::Matrix<double> other(k, n), left(n, m);
+    fillRandom(other);
+    fillRandom(left);
+    LinearAlgebra::Matrix<double> expected_right = dense * other;
+    LinearAlgebra::Matrix<double> expected_left = left * dense;
+
+    LinearAlgebra::SparseMatrix<double> csr(dense);
+    LinearAlgebra::SparseMatrix<double> csc = csr.toFormat(LinearAlgebra::SparseFormat::CSC);
+    assert(csr.nonZeros() == csc.nonZeros() && csr.nonZeros() < static_cast<std::size_t>(m * k / 10));
+    assert(csc.getFormat() == LinearAlgebra::SparseFormat::CSC && csc.getOffsets().size() == static_cast<std::size_t>(k + 1));
+    assert(maxAbsDifference(csr.toDense(), dense) == 0.0 && maxAbsDifference(csc.toDense(), dense) == 0.0);
+    assert(maxAbsDifference(LinearAlgebra::SparseMatrix<double>(dense, LinearAlgebra::SparseFormat::CSC).toDense(), dense) == 0.0);
+    assert(csr.get(7, 3) == dense(7, 3) && csc.get(7, 3) == dense(7, 3) && csr.get(0, k - 1) == 0.0);
+
+    LinearAlgebra::Matrix<double> dense_transposed(dense);
+    dense_transposed.transpose();
+    assert(maxAbsDifference(csr.transposed().toDense(), dense_transposed) == 0.0);
+    assert(maxAbsDifference(csc.transposed().toDense(), dense_transposed) == 0.0);
+
+    std::vector<double> x(k);
+    for (int p = 0; p < k; ++p) x[p] = 0.25 * p - 3.0;
+    for (int round = 0; round < 2; ++round) {
+        if (round == 1) {
+            LinearAlgebra::setNumThreads(4);
+            LinearAlgebra::setParallelThreshold(0);
+        }
+        for (const LinearAlgebra::SparseMatrix<double>* sparse : {&csr, &csc}) {
+            std::vector<double> y = *sparse * x;
+            for (int i = 0; i < m; ++i) {
+                double expected = 0.0;
+                for (int p = 0; p < k; ++p) expected += dense(i, p) * x[p];
+                assert(std::fabs(y[i] - expected) < 1e-9);
+            }
+            assert(maxAbsDifference(*sparse * other, expected_right) < 1e-9);
+            assert(maxAbsDifference(left * *sparse, expected_left) < 1e-9);
+        }
+    }
+    LinearAlgebra::setNumThreads(1);
+    LinearAlgebra::setParallelThreshold(128 * 128 * 128);
+
+    // Entries in any order, duplicates summed; compressed arrays are validated.
+    std::vector<LinearAlgebra::SparseEntry<int>> entries = {{2, 1, 5}, {0, 3, 1}, {2, 1, -2}, {0, 0, 4}, {1, 2, 7}};
+    LinearAlgebra::SparseMatrix<int> from_entries(3, 4, entries, LinearAlgebra::SparseFormat::CSC);
+    assert(from_entries.nonZeros() == 4 && from_entries.get(2, 1) == 3 && from_entries.get(1, 2) == 7);
+    LinearAlgebra::SparseMatrix<int> from_arrays(3, 4, {0, 2, 3, 4}, {0, 3, 2, 1}, {4, 1, 7, 3});
+    assert(maxAbsDifference(from_arrays.toDense(), from_entries.toDense()) == 0);
+    for (int bad_rows : {-1, -2}) {
+        try {
+            LinearAlgebra::SparseMatrix<int> negative(bad_rows, 4, LinearAlgebra::SparseFormat::CSR);
+            assert(false);
+        } catch (const std::invalid_argument&) {
+        }
+    }
+    try {
+        LinearAlgebra::SparseMatrix<int> negative(3, -1, {0, 0, 0, 0}, {}, {});
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+    try {
+        LinearAlgebra::SparseMatrix<int> unsorted(3, 4, {0, 2, 3, 4}, {3, 0, 2, 1}, {1, 4, 7, 3});
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+    try {
+        LinearAlgebra::Matrix<double> product = csr * left;
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+    std::cout << "Expected Output: sparse results match the dense computations\n";
+    std::cout << "Actual Output: sparse results match the dense computations\n";
+}
+
+void testInstrumentation() {
+    std::cout << "\nTest: Per-operation instrumentation counters and JSON snapshot\n";
+    LinearAlgebra::Matrix<double> a(48, 40), b(40, 24);
+    fillRandom(a);
+    fillRandom(b);
+    LinearAlgebra::resetInstrumentation();
+    LinearAlgebra::Matrix<double> c = a * b;
+    LinearAlgebra::Matrix<double> copy(c);
+    copy.transpose();
+    copy = c + c;
+    std::vector<LinearAlgebra::OperationStats> snapshot = LinearAlgebra::instrumentationSnapshot();
+    std::ostringstream json;
+    LinearAlgebra::writeInstrumentationJson(json);
+    if (!LinearAlgebra::instrumentationEnabled()) {
+        // Without LINEAR_ALGEBRA_INSTRUMENTATION the hooks compile to nothing and nothing is counted.
+        assert(snapshot.empty() && json.str().find("\"operations\": [\n  ]") != std::string::npos);
+        std::cout << "Expected Output: no counters without LINEAR_ALGEBRA_INSTRUMENTATION\n";
+        std::cout << "Actual Output: no counters without LINEAR_ALGEBRA_INSTRUMENTATION\n";
+        return;
+    }
+    auto find = [&](LinearAlgebra::Operation operation, std::size_t bucket) {
+        for (const LinearAlgebra::OperationStats& stats : snapshot) {
+            if (stats.operation == operation && stats.bucket == bucket) return stats;
+        }
+        LinearAlgebra::OperationStats none = LinearAlgebra::OperationStats();
+        return none;
+    };
+    LinearAlgebra::OperationStats multiply = find(LinearAlgebra::Operation::Multiply, 64);
+    assert(multiply.calls == 1 && multiply.flops == 2u * 48 * 40 * 24);
+    assert(multiply.bytes == (48u * 40 + 40 * 24 + 48 * 24) * sizeof(double) && multiply.seconds > 0);
+    LinearAlgebra::OperationStats transpose = find(LinearAlgebra::Operation::Transpose, 64);
+    assert(transpose.calls == 1 && transpose.bytes == 2u * 48 * 24 * sizeof(double));
+    // Buffers of c and copy; c + c is evaluated into copy's existing buffer.
+    LinearAlgebra::OperationStats allocate = find(LinearAlgebra::Operation::Allocate, 2048);
+    assert(allocate.calls == 2 && allocate.bytes == 2u * 48 * 24 * sizeof(double));
+    assert(find(LinearAlgebra::Operation::Copy, 2048).calls == 1);
+    assert(find(LinearAlgebra::Operation::Elementwise, 64).calls == 1);
+    assert(json.str().find("{\"operation\": \"multiply\", \"bucket\": 64, \"calls\": 1,") != std::string::npos);
+
+    // Assignments that grow their destination allocate without first copying the old contents over.
+    LinearAlgebra::Matrix<double> small(2, 2), product(2, 2);
+    LinearAlgebra::resetInstrumentation();
+    small = c;
+    product = a * b;
+    snapshot = LinearAlgebra::instrumentationSnapshot();
+    std::uint64_t copies = 0;
+    for (const LinearAlgebra::OperationStats& stats : snapshot) {
+        if (stats.operation == LinearAlgebra::Operation::Copy) copies += stats.calls;
+    }
+    assert(copies == 1);  // Only small = c itself.
+
+    LinearAlgebra::resetInstrumentation();
+    assert(LinearAlgebra::instrumentationSnapshot().empty());
+    std::cout << "Expected Output: one multiply, transpose, copy and elementwise call, two allocations\n";
+    std::cout << "Actual Output: one multiply, transpose, copy and elementwise call, two allocations\n";
+}
+
 int main() {
 
     // All test cases
@@ -182,6 +1100,22 @@ int main() {
     testMultiplicationException();
     testLargeMultiplication();
     testLargeTranspose();
+    testBlockedMultiplication();
+    testSimdDispatch();
+    testParallelMultiplyAndTranspose();
+    testExpressionTemplates();
+    testTransposeInPlaceAndInto();
+    testMatrixView();
+    testAlignedPooledStorage();
+    testOwnershipAndAllocations();
+    testFixedSizeMatrix();
+    testBinaryFilesAndTextOutput();
+    testStreamingMultiply();
+    testBatchMultiply();
+    testMixedPrecisionMultiply();
+    testElementAccessAndIterators();
+    testSparseMatrix();
+    testInstrumentation();
 
     std::cout << "\nAll tests passed!" << std::endl;
     return 0;